@@ -0,0 +1,45 @@
+#!/bin/sh
+# Downloads real info.0.json records into bench/corpus, see `make bench-corpus`
+# Samples every STEP-th comic and keeps the ones that stress the parser most: the biggest records
+# (long transcripts), the ones with the most \u escapes and the ones with markup in news
+set -e
+
+STEP=${STEP:-10}
+KEEP=${KEEP:-4}
+corpus=$(dirname "$0")/corpus
+samples=$(mktemp -d)
+trap 'rm -rf "$samples"' EXIT
+
+latest=$(curl -sf https://xkcd.com/info.0.json | sed 's/.*"num": *\([0-9]*\).*/\1/')
+num=1
+while [ "$num" -le "$latest" ]; do
+    # 404 is not a comic
+    if [ "$num" -ne 404 ]; then
+        curl -sf "https://xkcd.com/$num/info.0.json" -o "$samples/$num.json" || rm -f "$samples/$num.json"
+    fi
+    num=$((num + STEP))
+done
+
+keep() {
+    sort -rn | head -n "$KEEP" | while read -r score file; do
+        if [ "$score" -gt 0 ]; then
+            cp "$file" "$corpus/"
+        fi
+    done
+}
+
+for file in "$samples"/*.json; do
+    echo "$(wc -c < "$file") $file"
+done | keep
+for file in "$samples"/*.json; do
+    echo "$(grep -o '\\u' "$file" | wc -l) $file"
+done | keep
+for file in "$samples"/*.json; do
+    if grep -q '"news": ""' "$file"; then
+        echo "0 $file"
+    else
+        echo "$(wc -c < "$file") $file"
+    fi
+done | keep
+
+ls "$corpus"
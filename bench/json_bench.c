@@ -0,0 +1,473 @@
+// Throughput and allocation benchmark of json.h, see `make bench`
+#define _POSIX_C_SOURCE 199309L
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Every allocation json.h makes goes through these, so they can be counted per document
+static size_t num_allocations = 0;
+
+static void* bench_malloc(size_t size) {
+    num_allocations++;
+    return malloc(size);
+}
+
+static void* bench_realloc(void* data, size_t size) {
+    num_allocations++;
+    return realloc(data, size);
+}
+
+#define malloc(size) bench_malloc(size)
+#define realloc(data, size) bench_realloc(data, size)
+#include "../src/json.h"
+#undef malloc
+#undef realloc
+
+#define MIN_ITERATIONS 10
+#define MAX_ITERATIONS 100000
+// A benchmark is repeated until it has run for this long, or MAX_ITERATIONS times
+#define DEFAULT_MIN_TIME 0.25
+// A benchmark counts as regressed when it is this much slower than its baseline
+#define REGRESSION_THRESHOLD 0.10
+#define STREAM_CHUNK_SIZE (16 * 1024)
+#define MAX_RESULTS 1024
+#define MAX_DOCUMENTS 64
+// Documents generated by the benchmark itself, after the files
+#define NUM_SYNTHETIC 5
+
+typedef struct {
+    char name[64];
+    char* text;
+    size_t size;
+    char* scratch; // Copy of text for json_parse_in_situ, which writes into its input
+    struct json_value_s* dom; // Parsed once up front for the benchmarks that start from a DOM
+    struct json_stream_s* stream;
+    // Memory handed out by block_alloc, kept from one iteration to the next like an arena that is reset
+    char* block;
+    size_t block_capacity;
+} document_t;
+
+typedef struct {
+    const char* name;
+    void (*prepare)(document_t* document); // Optional, runs before every iteration and is not timed
+    void* (*run)(document_t* document); // Returns an allocation that is freed after the timing
+} benchmark_t;
+
+typedef struct {
+    char document[64];
+    char benchmark[64];
+    double mb_per_s;
+    double allocations; // Per document
+} result_t;
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void* run_parse(document_t* document) {
+    return json_parse(document->text, document->size);
+}
+
+static void* run_parse_json5(document_t* document) {
+    return json_parse_ex(document->text, document->size, json_parse_flags_allow_json5, NULL, NULL, NULL);
+}
+
+static void* run_parse_location(document_t* document) {
+    return json_parse_ex(document->text, document->size, json_parse_flags_allow_location_information, NULL, NULL, NULL);
+}
+
+static void* run_parse_object_index(document_t* document) {
+    return json_parse_ex(document->text, document->size, json_parse_flags_build_object_index, NULL, NULL, NULL);
+}
+
+static void prepare_in_situ(document_t* document) {
+    memcpy(document->scratch, document->text, document->size);
+}
+
+// The custom allocator of json_parse_ex and json_stream_finish_ex, which ask for one block per document.
+// Only growing the block allocates, so after the first iteration these paths must not touch the heap
+static void* block_alloc(void* user_data, size_t size) {
+    document_t* document = (document_t*) user_data;
+    if (size > document->block_capacity) {
+        char* block = bench_realloc(document->block, size);
+        if (block == NULL) {
+            return NULL;
+        }
+        document->block = block;
+        document->block_capacity = size;
+    }
+    return document->block;
+}
+
+static void* run_parse_block(document_t* document) {
+    json_parse_ex(document->text, document->size, json_parse_flags_default, block_alloc, document, NULL);
+    return NULL;
+}
+
+static void* run_parse_in_situ(document_t* document) {
+    return json_parse_in_situ(document->scratch, document->size, NULL, NULL, NULL);
+}
+
+static void prepare_stream(document_t* document) {
+    json_stream_reset(document->stream);
+}
+
+// Like a download, the text arrives in chunks and the parser is reused from one document to the next
+static void* run_stream(document_t* document) {
+    for (size_t offset = 0; offset < document->size; offset += STREAM_CHUNK_SIZE) {
+        size_t size = document->size - offset < STREAM_CHUNK_SIZE ? document->size - offset : STREAM_CHUNK_SIZE;
+        json_stream_feed(document->stream, document->text + offset, size);
+    }
+    return json_stream_finish(document->stream, NULL);
+}
+
+static void* run_stream_block(document_t* document) {
+    for (size_t offset = 0; offset < document->size; offset += STREAM_CHUNK_SIZE) {
+        size_t size = document->size - offset < STREAM_CHUNK_SIZE ? document->size - offset : STREAM_CHUNK_SIZE;
+        json_stream_feed(document->stream, document->text + offset, size);
+    }
+    json_stream_finish_ex(document->stream, block_alloc, document, NULL);
+    return NULL;
+}
+
+static void* run_select_fields(document_t* document) {
+    struct json_field_s fields[] = { { .path = "num" }, { .path = "title" } };
+    json_select_fields(document->text, document->size, fields, 2);
+    return NULL;
+}
+
+static void* run_extract(document_t* document) {
+    return json_extract_value(document->dom);
+}
+
+static void* run_write_minified(document_t* document) {
+    return json_write_minified(document->dom, NULL);
+}
+
+static void* run_write_pretty(document_t* document) {
+    return json_write_pretty(document->dom, "  ", "\n", NULL);
+}
+
+static const benchmark_t benchmarks[] = {
+    { "json_parse", NULL, run_parse },
+    { "json_parse_ex json5", NULL, run_parse_json5 },
+    { "json_parse_ex location", NULL, run_parse_location },
+    { "json_parse_ex object_index", NULL, run_parse_object_index },
+    { "json_parse_ex alloc_func", NULL, run_parse_block },
+    { "json_parse_in_situ", prepare_in_situ, run_parse_in_situ },
+    { "json_stream", prepare_stream, run_stream },
+    { "json_stream_finish_ex alloc_func", prepare_stream, run_stream_block },
+    { "json_select_fields", NULL, run_select_fields },
+    { "json_extract_value", NULL, run_extract },
+    { "json_write_minified", NULL, run_write_minified },
+    { "json_write_pretty", NULL, run_write_pretty },
+};
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// MB/s are of the document text for every benchmark, writers included, and taken from the median iteration
+static result_t run_benchmark(const benchmark_t* benchmark, document_t* document, double min_time) {
+    static double times[MAX_ITERATIONS];
+    int iterations = 0;
+    double total = 0.0;
+    size_t allocations = num_allocations;
+    while (iterations < MAX_ITERATIONS && (iterations < MIN_ITERATIONS || total < min_time)) {
+        if (benchmark->prepare) {
+            benchmark->prepare(document);
+        }
+        double start = now();
+        void* result = benchmark->run(document);
+        double time = now() - start;
+        free(result);
+        times[iterations++] = time;
+        total += time;
+    }
+    allocations = num_allocations - allocations;
+    qsort(times, iterations, sizeof(double), compare_doubles);
+
+    result_t result = {0};
+    snprintf(result.document, sizeof(result.document), "%.63s", document->name);
+    snprintf(result.benchmark, sizeof(result.benchmark), "%.63s", benchmark->name);
+    double median = times[iterations / 2] > 0.0 ? times[iterations / 2] : 1e-9;
+    result.mb_per_s = document->size / median / 1e6;
+    result.allocations = (double) allocations / iterations;
+    return result;
+}
+
+static bool prepare_document(document_t* document) {
+    document->dom = json_parse(document->text, document->size);
+    if (document->dom == NULL) {
+        fprintf(stderr, "%s is not valid JSON\n", document->name);
+        return false;
+    }
+    document->scratch = malloc(document->size);
+    document->stream = json_stream_create(NULL, NULL);
+    return document->scratch && document->stream;
+}
+
+static void free_document(document_t* document) {
+    free(document->text);
+    free(document->scratch);
+    free(document->dom);
+    json_stream_destroy(document->stream);
+    free(document->block);
+}
+
+static bool load_document(const char* path, document_t* document) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    document->text = malloc(size > 0 ? size : 1);
+    document->size = size > 0 ? (size_t) size : 0;
+    bool ok = document->text && fread(document->text, 1, document->size, file) == document->size;
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Could not read %s\n", path);
+        return false;
+    }
+    const char* name = strrchr(path, '/');
+    snprintf(document->name, sizeof(document->name), "%s", name ? name + 1 : path);
+    return true;
+}
+
+// Growable text the synthetic documents are printed into
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} text_t;
+
+static void append(text_t* text, const char* format, ...) {
+    for (;;) {
+        va_list arguments;
+        va_start(arguments, format);
+        int size = vsnprintf(text->data + text->size, text->capacity - text->size, format, arguments);
+        va_end(arguments);
+        if (size >= 0 && text->size + size < text->capacity) {
+            text->size += size;
+            return;
+        }
+        text->capacity = text->capacity ? text->capacity * 2 : 1 << 16;
+        text->data = realloc(text->data, text->capacity);
+    }
+}
+
+static unsigned int random_state = 1;
+
+static unsigned int next_random(void) {
+    random_state = random_state * 1103515245u + 12345u;
+    return (random_state >> 16) & 0x7fff;
+}
+
+// An array of comics like a mirror of the whole archive, transcripts make up most of it
+static void make_archive(text_t* text) {
+    static const char* words[] = { "Cueball", "Megan", "Hat", "Guy", "stick", "figure", "looks", "at", "the", "chart", "graph", "says", "physics", "sky" };
+    append(text, "[");
+    for (int num = 1; num <= 3000; num++) {
+        append(text, "%s{\"month\": \"%d\", \"num\": %d, \"link\": \"\", \"year\": \"%d\", \"news\": \"\", \"safe_title\": \"Comic %d\", \"transcript\": \"",
+            num > 1 ? ", " : "", num % 12 + 1, num, 2006 + num / 160, num);
+        for (int line = 0; line < 8; line++) {
+            append(text, "%s:", words[next_random() % 2]);
+            for (int word = 0; word < 12; word++) {
+                append(text, " %s", words[next_random() % 14]);
+            }
+            append(text, " \\\"quote\\\" it\\u2019s\\n");
+        }
+        append(text, "\", \"alt\": \"Alt text of comic %d.\", \"img\": \"https://imgs.xkcd.com/comics/comic_%d.png\", \"title\": \"Comic %d\", \"day\": \"%d\"}",
+            num, num, num, num % 28 + 1);
+    }
+    append(text, "]");
+}
+
+static void make_numbers(text_t* text) {
+    append(text, "[");
+    for (int i = 0; i < 200000; i++) {
+        const char* separator = i ? ", " : "";
+        switch (i % 4) {
+            case 0:
+                append(text, "%s%u", separator, next_random() * next_random());
+                break;
+            case 1:
+                append(text, "%s-%u.%03u", separator, next_random(), next_random() % 1000);
+                break;
+            case 2:
+                append(text, "%s%u.%ue-%u", separator, next_random() % 10, next_random(), next_random() % 300);
+                break;
+            default:
+                append(text, "%s0", separator);
+                break;
+        }
+    }
+    append(text, "]");
+}
+
+static void make_strings(text_t* text) {
+    append(text, "[");
+    for (int i = 0; i < 64; i++) {
+        append(text, "%s\"", i ? ", " : "");
+        for (int j = 0; j < 16 * 1024 / 64; j++) {
+            append(text, "%s", j % 16 == 15 ? "plain text with an escape \\\"here\\\" and a tab\\t somewhere.\\n" : "plain text that runs on and on without anything to unescape.");
+        }
+        append(text, "\"");
+    }
+    append(text, "]");
+}
+
+static void make_nested(text_t* text) {
+    for (int i = 0; i < 500; i++) {
+        append(text, "{\"level\": %d, \"children\": [", i);
+    }
+    for (int i = 0; i < 500; i++) {
+        append(text, "]}");
+    }
+}
+
+static void add_synthetic(document_t* document, const char* name, void (*make)(text_t*)) {
+    text_t text = {0};
+    make(&text);
+    snprintf(document->name, sizeof(document->name), "%s", name);
+    document->text = text.data;
+    document->size = text.size;
+}
+
+static void add_pretty(document_t* document, const document_t* compact, const char* name) {
+    struct json_value_s* dom = json_parse(compact->text, compact->size);
+    size_t size = 0;
+    document->text = json_write_pretty(dom, "  ", "\n", &size);
+    document->size = size - 1; // Without the terminator
+    snprintf(document->name, sizeof(document->name), "%s", name);
+    free(dom);
+}
+
+static int load_baseline(const char* path, result_t* results) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    int num_results = 0;
+    char line[256];
+    while (num_results < MAX_RESULTS && fgets(line, sizeof(line), file)) {
+        result_t* result = &results[num_results];
+        if (sscanf(line, "%63[^\t]\t%63[^\t]\t%lf\t%lf", result->document, result->benchmark, &result->mb_per_s, &result->allocations) == 4) {
+            num_results++;
+        }
+    }
+    fclose(file);
+    return num_results;
+}
+
+static const result_t* find_result(const result_t* results, int num_results, const result_t* key) {
+    for (int i = 0; i < num_results; i++) {
+        if (strcmp(results[i].document, key->document) == 0 && strcmp(results[i].benchmark, key->benchmark) == 0) {
+            return &results[i];
+        }
+    }
+    return NULL;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: json_bench [--save FILE] [--baseline FILE] [--min-time SECONDS] [file.json...]\n"
+        "Runs every benchmark over the files and a few synthetic documents and reports MB/s of the document text\n"
+        "and allocations per document. --save writes the results as a baseline, --baseline compares against one and\n"
+        "fails if a benchmark got more than %.0f%% slower or allocates more\n", REGRESSION_THRESHOLD * 100);
+}
+
+int main(int argc, char* argv[]) {
+    const char* save_path = NULL;
+    const char* baseline_path = NULL;
+    double min_time = DEFAULT_MIN_TIME;
+    static document_t documents[MAX_DOCUMENTS];
+    int num_documents = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_time = atof(argv[++i]);
+        }
+        else if (argv[i][0] == '-') {
+            usage();
+            return 1;
+        }
+        else if (num_documents == MAX_DOCUMENTS - NUM_SYNTHETIC) {
+            fprintf(stderr, "Too many files, at most %d\n", MAX_DOCUMENTS - NUM_SYNTHETIC);
+            return 1;
+        }
+        else if (!load_document(argv[i], &documents[num_documents++])) {
+            return 1;
+        }
+    }
+    int archive = num_documents;
+    add_synthetic(&documents[num_documents++], "synthetic archive", make_archive);
+    add_pretty(&documents[num_documents++], &documents[archive], "synthetic archive pretty");
+    add_synthetic(&documents[num_documents++], "synthetic numbers", make_numbers);
+    add_synthetic(&documents[num_documents++], "synthetic strings", make_strings);
+    add_synthetic(&documents[num_documents++], "synthetic nested", make_nested);
+
+    static result_t baseline[MAX_RESULTS];
+    int num_baseline = baseline_path ? load_baseline(baseline_path, baseline) : -1;
+    if (baseline_path && num_baseline < 0) {
+        printf("No baseline at %s yet, create one with --save\n", baseline_path);
+    }
+
+    static result_t results[MAX_RESULTS];
+    int num_results = 0;
+    int regressions = 0;
+    printf("%-30s %10s  %-32s %9s %11s %9s\n", "document", "bytes", "benchmark", "MB/s", "allocs/doc", "baseline");
+    for (int i = 0; i < num_documents; i++) {
+        document_t* document = &documents[i];
+        if (!prepare_document(document)) {
+            return 1;
+        }
+        for (size_t j = 0; j < sizeof(benchmarks) / sizeof(benchmarks[0]) && num_results < MAX_RESULTS; j++) {
+            result_t* result = &results[num_results++];
+            *result = run_benchmark(&benchmarks[j], document, min_time);
+            printf("%-30s %10zu  %-32s %9.1f %11.2f", result->document, document->size, result->benchmark, result->mb_per_s, result->allocations);
+            const result_t* before = num_baseline > 0 ? find_result(baseline, num_baseline, result) : NULL;
+            if (before) {
+                double change = result->mb_per_s / before->mb_per_s - 1.0;
+                bool regressed = change < -REGRESSION_THRESHOLD || result->allocations > before->allocations + 0.01;
+                printf(" %+8.1f%%%s", change * 100.0, regressed ? "  REGRESSION" : "");
+                regressions += regressed;
+            }
+            printf("\n");
+        }
+        free_document(document);
+    }
+
+    if (save_path) {
+        FILE* file = fopen(save_path, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Could not write %s\n", save_path);
+            return 1;
+        }
+        for (int i = 0; i < num_results; i++) {
+            fprintf(file, "%s\t%s\t%.1f\t%.2f\n", results[i].document, results[i].benchmark, results[i].mb_per_s, results[i].allocations);
+        }
+        fclose(file);
+        printf("Saved the baseline to %s\n", save_path);
+    }
+    if (regressions > 0) {
+        printf("%d benchmarks regressed\n", regressions);
+        return 1;
+    }
+    return 0;
+}
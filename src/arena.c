@@ -0,0 +1,68 @@
+#include "arena.h"
+
+#define ARENA_MIN_BLOCK_SIZE (16 * 1024)
+#define ARENA_ALIGNMENT 16
+
+struct arena_block_s {
+    struct arena_block_s* next;
+    size_t size; // Bytes of data following the header
+};
+
+static size_t align_up(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+}
+
+static char* block_data(arena_block_t* block) {
+    return (char*) block + align_up(sizeof(arena_block_t));
+}
+
+static arena_block_t* create_block(size_t size) {
+    arena_block_t* block = (arena_block_t*) SDL_malloc(align_up(sizeof(arena_block_t)) + size);
+    if (block) {
+        block->next = NULL;
+        block->size = size;
+    }
+    return block;
+}
+
+void* arena_alloc(void* data, size_t size) {
+    arena_t* arena = (arena_t*) data;
+    size_t offset = align_up(arena->used);
+    if (arena->blocks == NULL || offset + size > arena->blocks->size) {
+        size_t block_size = arena->blocks ? arena->blocks->size * 2 : ARENA_MIN_BLOCK_SIZE;
+        arena_block_t* block = create_block(SDL_max(block_size, size));
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = arena->blocks;
+        arena->blocks = block;
+        offset = 0;
+    }
+    arena->used = offset + size;
+    return block_data(arena->blocks) + offset;
+}
+
+void arena_reset(arena_t* arena) {
+    arena->used = 0;
+    if (arena->blocks == NULL || arena->blocks->next == NULL) {
+        return;
+    }
+    // Replace the blocks by a single one that holds all of them, so the next round needs no new block
+    size_t total = 0;
+    while (arena->blocks) {
+        arena_block_t* next = arena->blocks->next;
+        total += arena->blocks->size;
+        SDL_free(arena->blocks);
+        arena->blocks = next;
+    }
+    arena->blocks = create_block(total);
+}
+
+void arena_destroy(arena_t* arena) {
+    while (arena->blocks) {
+        arena_block_t* next = arena->blocks->next;
+        SDL_free(arena->blocks);
+        arena->blocks = next;
+    }
+    arena->used = 0;
+}
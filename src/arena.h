@@ -0,0 +1,24 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <SDL3/SDL.h>
+
+typedef struct arena_block_s arena_block_t;
+
+// Bump allocator for short lived allocations that are released all at once. The memory is kept across
+// resets, so once an arena has grown to its working size allocating from it no longer touches the heap
+typedef struct {
+    arena_block_t* blocks; // The block allocations come from, followed by the older ones
+    size_t used; // Bytes handed out from the first block
+} arena_t;
+
+// Has the signature json_parse_ex expects for alloc_func_ptr, with the arena as user_data.
+// Returns NULL if the heap is exhausted
+void* arena_alloc(void* arena, size_t size);
+
+// Releases everything allocated from the arena
+void arena_reset(arena_t* arena);
+
+void arena_destroy(arena_t* arena);
+
+#endif
@@ -0,0 +1,308 @@
+#include <SDL3/SDL.h>
+#include "atlas.h"
+
+#define ATLAS_PAGE_SIZE 2048
+#define ATLAS_MAX_PAGES 32
+// Shelf heights are rounded up so images of similar height end up sharing a shelf
+#define ATLAS_SHELF_ROUNDING 8
+// Empty pixels right of and below every region, keeps linear filtering from bleeding neighbours in
+#define ATLAS_GUTTER 1
+
+// Free run of pixels on a shelf, left of the shelf's cursor
+typedef struct {
+    int x;
+    int w;
+} atlas_span_t;
+
+// A horizontal strip of a page, regions are packed into it from left to right
+typedef struct {
+    int y;
+    int height;
+    int cursor; // Everything right of the cursor is free
+    int live; // Number of regions on the shelf
+    atlas_span_t* free_spans; // Holes left by removed regions, sorted by x and never adjacent
+    int num_free_spans;
+    int free_spans_capacity;
+} atlas_shelf_t;
+
+typedef struct {
+    SDL_Texture* texture;
+    atlas_shelf_t* shelves; // Sorted by y, the last one ends at used_height
+    int num_shelves;
+    int shelves_capacity;
+    int used_height;
+    // Quads queued by atlas_draw
+    SDL_Vertex* vertices;
+    int num_vertices;
+    int vertices_capacity;
+    int* indices;
+    int num_indices;
+    int indices_capacity;
+} atlas_page_t;
+
+static SDL_Renderer* atlas_renderer = NULL;
+static atlas_page_t pages[ATLAS_MAX_PAGES];
+static int num_pages = 0;
+static int page_size = 0;
+
+static void* grow(void* data, int* capacity, int needed, size_t element_size) {
+    if (needed <= *capacity) {
+        return data;
+    }
+    int new_capacity = *capacity ? *capacity * 2 : 16;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    char* result = (char*) SDL_realloc(data, element_size * new_capacity);
+    SDL_memset(result + element_size * *capacity, 0, element_size * (new_capacity - *capacity));
+    *capacity = new_capacity;
+    return result;
+}
+
+static bool shelf_fits(const atlas_shelf_t* shelf, int w) {
+    for (int i = 0; i < shelf->num_free_spans; i++) {
+        if (shelf->free_spans[i].w >= w) {
+            return true;
+        }
+    }
+    return shelf->cursor + w <= page_size;
+}
+
+static int shelf_alloc(atlas_shelf_t* shelf, int w) {
+    shelf->live++;
+    for (int i = 0; i < shelf->num_free_spans; i++) {
+        atlas_span_t* span = &shelf->free_spans[i];
+        if (span->w >= w) {
+            int x = span->x;
+            span->x += w;
+            span->w -= w;
+            if (span->w == 0) {
+                SDL_memmove(span, span + 1, sizeof(atlas_span_t) * (shelf->num_free_spans - i - 1));
+                shelf->num_free_spans--;
+            }
+            return x;
+        }
+    }
+    int x = shelf->cursor;
+    shelf->cursor += w;
+    return x;
+}
+
+static void shelf_free(atlas_shelf_t* shelf, int x, int w) {
+    shelf->live--;
+    if (shelf->live == 0) {
+        shelf->cursor = 0;
+        shelf->num_free_spans = 0;
+        return;
+    }
+    if (x + w == shelf->cursor) {
+        // Give the space back to the cursor, together with a hole that now touches it
+        shelf->cursor = x;
+        atlas_span_t* last = shelf->num_free_spans ? &shelf->free_spans[shelf->num_free_spans - 1] : NULL;
+        if (last && last->x + last->w == shelf->cursor) {
+            shelf->cursor = last->x;
+            shelf->num_free_spans--;
+        }
+        return;
+    }
+    int index = 0;
+    while (index < shelf->num_free_spans && shelf->free_spans[index].x < x) {
+        index++;
+    }
+    atlas_span_t* previous = index > 0 ? &shelf->free_spans[index - 1] : NULL;
+    atlas_span_t* next = index < shelf->num_free_spans ? &shelf->free_spans[index] : NULL;
+    bool merge_previous = previous && previous->x + previous->w == x;
+    bool merge_next = next && x + w == next->x;
+    if (merge_previous && merge_next) {
+        previous->w += w + next->w;
+        SDL_memmove(next, next + 1, sizeof(atlas_span_t) * (shelf->num_free_spans - index - 1));
+        shelf->num_free_spans--;
+    }
+    else if (merge_previous) {
+        previous->w += w;
+    }
+    else if (merge_next) {
+        next->x = x;
+        next->w += w;
+    }
+    else {
+        shelf->free_spans = (atlas_span_t*) grow(shelf->free_spans, &shelf->free_spans_capacity, shelf->num_free_spans + 1, sizeof(atlas_span_t));
+        atlas_span_t* span = &shelf->free_spans[index];
+        SDL_memmove(span + 1, span, sizeof(atlas_span_t) * (shelf->num_free_spans - index));
+        span->x = x;
+        span->w = w;
+        shelf->num_free_spans++;
+    }
+}
+
+static bool page_alloc(atlas_page_t* page, int w, int h, SDL_Rect* rect) {
+    // Prefer the shelf wasting the least height, but do not put short images on much taller shelves
+    // while a new shelf could still be opened
+    atlas_shelf_t* best = NULL;
+    atlas_shelf_t* fallback = NULL;
+    for (int i = 0; i < page->num_shelves; i++) {
+        atlas_shelf_t* shelf = &page->shelves[i];
+        if (shelf->height < h || !shelf_fits(shelf, w)) {
+            continue;
+        }
+        if (shelf->height < h * 2 && (best == NULL || shelf->height < best->height)) {
+            best = shelf;
+        }
+        if (fallback == NULL || shelf->height < fallback->height) {
+            fallback = shelf;
+        }
+    }
+    int shelf_height = (h + ATLAS_SHELF_ROUNDING - 1) / ATLAS_SHELF_ROUNDING * ATLAS_SHELF_ROUNDING;
+    shelf_height = SDL_min(shelf_height, page_size);
+    if (best == NULL && page->used_height + shelf_height <= page_size) {
+        page->shelves = (atlas_shelf_t*) grow(page->shelves, &page->shelves_capacity, page->num_shelves + 1, sizeof(atlas_shelf_t));
+        // Shelves popped off the top keep their span buffer for reuse
+        best = &page->shelves[page->num_shelves++];
+        best->y = page->used_height;
+        best->height = shelf_height;
+        best->cursor = 0;
+        best->live = 0;
+        best->num_free_spans = 0;
+        page->used_height += shelf_height;
+    }
+    if (best == NULL) {
+        best = fallback;
+    }
+    if (best == NULL) {
+        return false;
+    }
+    rect->x = shelf_alloc(best, w);
+    rect->y = best->y;
+    rect->w = w;
+    rect->h = h;
+    return true;
+}
+
+static atlas_page_t* open_page(void) {
+    if (num_pages == ATLAS_MAX_PAGES) {
+        return NULL;
+    }
+    SDL_Texture* texture = SDL_CreateTexture(atlas_renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, page_size, page_size);
+    if (texture == NULL) {
+        SDL_Log("Could not create atlas page: '%s'\n", SDL_GetError());
+        return NULL;
+    }
+    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_LINEAR);
+    // The gutters have to be transparent, a new texture starts out with undefined contents
+    void* zeros = SDL_calloc((size_t) page_size * page_size, 4);
+    if (zeros) {
+        SDL_UpdateTexture(texture, NULL, zeros, page_size * 4);
+        SDL_free(zeros);
+    }
+    atlas_page_t* page = &pages[num_pages++];
+    SDL_zerop(page);
+    page->texture = texture;
+    return page;
+}
+
+bool atlas_init(SDL_Renderer* renderer) {
+    atlas_renderer = renderer;
+    SDL_PropertiesID properties = SDL_GetRendererProperties(renderer);
+    Sint64 max_texture_size = SDL_GetNumberProperty(properties, SDL_PROP_RENDERER_MAX_TEXTURE_SIZE_NUMBER, ATLAS_PAGE_SIZE);
+    page_size = (int) SDL_min(max_texture_size, ATLAS_PAGE_SIZE);
+    return page_size > 0;
+}
+
+bool atlas_insert(SDL_Surface* surface, atlas_region_t* region) {
+    int w = surface->w + ATLAS_GUTTER;
+    int h = surface->h + ATLAS_GUTTER;
+    if (w > page_size || h > page_size) {
+        SDL_Log("Image of %dx%d does not fit into an atlas page", surface->w, surface->h);
+        return false;
+    }
+    SDL_Rect rect;
+    int page_index = 0;
+    while (page_index < num_pages && !page_alloc(&pages[page_index], w, h, &rect)) {
+        page_index++;
+    }
+    if (page_index == num_pages && (open_page() == NULL || !page_alloc(&pages[page_index], w, h, &rect))) {
+        SDL_Log("The texture atlas is full");
+        return false;
+    }
+    region->page = page_index;
+    region->rect = (SDL_Rect) { rect.x, rect.y, surface->w, surface->h };
+    SDL_UpdateTexture(pages[page_index].texture, &region->rect, surface->pixels, surface->pitch);
+    return true;
+}
+
+void atlas_remove(const atlas_region_t* region) {
+    atlas_page_t* page = &pages[region->page];
+    for (int i = 0; i < page->num_shelves; i++) {
+        if (page->shelves[i].y == region->rect.y) {
+            shelf_free(&page->shelves[i], region->rect.x, region->rect.w + ATLAS_GUTTER);
+            break;
+        }
+    }
+    // Empty shelves at the top of the page go away so their height can be used by any image again
+    while (page->num_shelves > 0 && page->shelves[page->num_shelves - 1].live == 0) {
+        page->num_shelves--;
+        page->used_height = page->shelves[page->num_shelves].y;
+    }
+}
+
+void atlas_draw(const atlas_region_t* region, SDL_FRect destination) {
+    atlas_page_t* page = &pages[region->page];
+    page->vertices = (SDL_Vertex*) grow(page->vertices, &page->vertices_capacity, page->num_vertices + 4, sizeof(SDL_Vertex));
+    page->indices = (int*) grow(page->indices, &page->indices_capacity, page->num_indices + 6, sizeof(int));
+
+    // Sample texel centers only, so filtering never reaches into the gutter
+    float size = (float) page_size;
+    float u0 = (region->rect.x + 0.5f) / size;
+    float v0 = (region->rect.y + 0.5f) / size;
+    float u1 = (region->rect.x + region->rect.w - 0.5f) / size;
+    float v1 = (region->rect.y + region->rect.h - 0.5f) / size;
+    float x0 = destination.x;
+    float y0 = destination.y;
+    float x1 = destination.x + destination.w;
+    float y1 = destination.y + destination.h;
+    SDL_FColor white = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    int base = page->num_vertices;
+    SDL_Vertex* vertex = &page->vertices[base];
+    vertex[0] = (SDL_Vertex) { { x0, y0 }, white, { u0, v0 } };
+    vertex[1] = (SDL_Vertex) { { x1, y0 }, white, { u1, v0 } };
+    vertex[2] = (SDL_Vertex) { { x1, y1 }, white, { u1, v1 } };
+    vertex[3] = (SDL_Vertex) { { x0, y1 }, white, { u0, v1 } };
+    page->num_vertices += 4;
+
+    int* index = &page->indices[page->num_indices];
+    index[0] = base;
+    index[1] = base + 1;
+    index[2] = base + 2;
+    index[3] = base;
+    index[4] = base + 2;
+    index[5] = base + 3;
+    page->num_indices += 6;
+}
+
+void atlas_flush(void) {
+    for (int i = 0; i < num_pages; i++) {
+        atlas_page_t* page = &pages[i];
+        if (page->num_indices > 0) {
+            SDL_RenderGeometry(atlas_renderer, page->texture, page->vertices, page->num_vertices, page->indices, page->num_indices);
+        }
+        page->num_vertices = 0;
+        page->num_indices = 0;
+    }
+}
+
+void atlas_shutdown(void) {
+    for (int i = 0; i < num_pages; i++) {
+        atlas_page_t* page = &pages[i];
+        for (int j = 0; j < page->shelves_capacity; j++) {
+            SDL_free(page->shelves[j].free_spans);
+        }
+        SDL_free(page->shelves);
+        SDL_free(page->vertices);
+        SDL_free(page->indices);
+        SDL_DestroyTexture(page->texture);
+        SDL_zerop(page);
+    }
+    num_pages = 0;
+    atlas_renderer = NULL;
+}
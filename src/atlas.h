@@ -0,0 +1,29 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+
+// A rectangle inside one of the atlas pages
+typedef struct {
+    int page;
+    SDL_Rect rect;
+} atlas_region_t;
+
+bool atlas_init(SDL_Renderer* renderer);
+
+// Copies an RGBA32 surface into a free spot of the atlas, opening a new page if none is left
+bool atlas_insert(SDL_Surface* surface, atlas_region_t* region);
+
+// Gives the space of a region back so later inserts can reuse it
+void atlas_remove(const atlas_region_t* region);
+
+// Queues a region to be drawn into destination, nothing reaches the renderer before atlas_flush
+void atlas_draw(const atlas_region_t* region, SDL_FRect destination);
+
+// Draws everything queued since the last flush with one SDL_RenderGeometry call per page
+void atlas_flush(void);
+
+void atlas_shutdown(void);
+
+#endif
@@ -0,0 +1,131 @@
+#include <SDL3/SDL.h>
+#include "config.h"
+
+typedef enum {
+    option_int,
+    option_float,
+    option_string,
+    option_flag // Takes no value, sets a bool
+} option_kind;
+
+typedef struct {
+    const char* name;
+    option_kind kind;
+    void* value;
+    double min, max; // Accepted range of int and float values
+    const char* help;
+} option_t;
+
+config_t config = {
+    .max_transfers = 0,
+    .rate_limit = 20.0f,
+    .max_retries = 3,
+    .retry_delay_ms = 250,
+    .connect_timeout_ms = 10000,
+    .stall_timeout_ms = 15000,
+    .hedge = false,
+    .cache_dir = NULL,
+    .metadata_ttl = 7 * 24 * 60 * 60,
+    .transport = "curl",
+    .base_url = "https://xkcd.com",
+    .canned_dir = "./canned",
+    .fake_latency_ms = 100,
+    .fake_failure_rate = 0.0f,
+    .decode_threads = 0,
+    .thumbnail_size = 256,
+    .poll_interval = 15 * 60,
+    .newest_count = 12,
+    .sync = false,
+    .sync_images = false
+};
+
+static const option_t options[] = {
+    { "--max-transfers", option_int, &config.max_transfers, 0, 4096, "maximum number of concurrent transfers (0 = 4 per core)" },
+    { "--rate-limit", option_float, &config.rate_limit, 0, 1000, "maximum number of requests started per second (0 = no limit)" },
+    { "--retries", option_int, &config.max_retries, 0, 100, "how often a transfer that failed with a transient error is retried" },
+    { "--retry-delay", option_int, &config.retry_delay_ms, 0, 60000, "delay before the first retry in milliseconds, doubles with every retry" },
+    { "--connect-timeout", option_int, &config.connect_timeout_ms, 0, SDL_MAX_SINT32, "milliseconds a connection may take to set up (0 = no limit)" },
+    { "--stall-timeout", option_int, &config.stall_timeout_ms, 0, SDL_MAX_SINT32, "milliseconds a transfer may go without receiving data (0 = no limit)" },
+    { "--hedge", option_flag, &config.hedge, 0, 0, "send a second copy of transfers that take longer than 95% of the others" },
+    { "--cache-dir", option_string, &config.cache_dir, 0, 0, "directory for cached comic metadata" },
+    { "--metadata-ttl", option_int, &config.metadata_ttl, 0, SDL_MAX_SINT32, "seconds cached metadata is used before it is revalidated" },
+    { "--transport", option_string, &config.transport, 0, 0, "backend for transfers: curl, file or fake" },
+    { "--base-url", option_string, &config.base_url, 0, 0, "where comics are fetched from" },
+    { "--canned-dir", option_string, &config.canned_dir, 0, 0, "directory of canned responses for the file transport" },
+    { "--fake-latency", option_int, &config.fake_latency_ms, 0, 600000, "average latency of the fake transport in milliseconds" },
+    { "--fake-failure-rate", option_float, &config.fake_failure_rate, 0, 1, "share of failed transfers of the fake transport (0 to 1)" },
+    { "--decode-threads", option_int, &config.decode_threads, 0, 256, "number of image decode threads (0 = all cores but two)" },
+    { "--thumbnail-size", option_int, &config.thumbnail_size, 1, 2048, "longest side of the downscaled comic images" },
+    { "--poll-interval", option_int, &config.poll_interval, 0, SDL_MAX_SINT32, "seconds between two checks for a new comic (0 = never)" },
+    { "--newest", option_int, &config.newest_count, 1, 10000, "number of comics the newest comics wall shows" },
+    { "--sync", option_flag, &config.sync, 0, 0, "mirror every comic into the cache and exit, without opening a window" },
+    { "--sync-images", option_flag, &config.sync_images, 0, 0, "also mirror the comic images when syncing" }
+};
+
+static void print_usage(const char* program) {
+    SDL_Log("Usage: %s [options]", program);
+    for (size_t i = 0; i < SDL_arraysize(options); i++) {
+        SDL_Log("  %-24s %s", options[i].name, options[i].help);
+    }
+}
+
+static bool parse_value(const option_t* option, const char* text) {
+    char* end = NULL;
+    double value;
+    switch (option->kind) {
+        case option_int:
+            value = (double) SDL_strtol(text, &end, 10);
+            if (end == text || *end != '\0' || value < option->min || value > option->max) {
+                return false;
+            }
+            *(int*) option->value = (int) value;
+            return true;
+        case option_float:
+            value = SDL_strtod(text, &end);
+            // Written so that NaN fails too
+            if (end == text || *end != '\0' || !(value >= option->min && value <= option->max)) {
+                return false;
+            }
+            *(float*) option->value = (float) value;
+            return true;
+        case option_string:
+            *(const char**) option->value = text;
+            return true;
+        case option_flag:
+            break;
+    }
+    return false;
+}
+
+bool config_parse(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const option_t* option = NULL;
+        for (size_t j = 0; j < SDL_arraysize(options); j++) {
+            if (SDL_strcmp(argv[i], options[j].name) == 0) {
+                option = &options[j];
+                break;
+            }
+        }
+        if (option == NULL) {
+            SDL_Log("Unknown option '%s'", argv[i]);
+            print_usage(argv[0]);
+            return false;
+        }
+        if (option->kind == option_flag) {
+            *(bool*) option->value = true;
+            continue;
+        }
+        if (i + 1 >= argc || !parse_value(option, argv[i + 1])) {
+            if (option->kind == option_string) {
+                SDL_Log("Option '%s' expects a value", option->name);
+            }
+            else {
+                SDL_Log("Option '%s' expects a number from %g to %g", option->name, option->min, option->max);
+            }
+            print_usage(argv[0]);
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
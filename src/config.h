@@ -0,0 +1,53 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+
+typedef struct {
+    // Maximum number of transfers the network thread runs at once (0 = derive from the number of cores)
+    int max_transfers;
+    // Maximum number of requests started per second (0 = no limit)
+    float rate_limit;
+    // How often a transfer that failed with a transient error is tried again, and the delay before the
+    // first retry (it doubles with every further one)
+    int max_retries;
+    int retry_delay_ms;
+    // Milliseconds a connection may take to set up, and a running transfer may go without receiving any
+    // data, before it fails as a timeout (0 = wait forever)
+    int connect_timeout_ms;
+    int stall_timeout_ms;
+    // Start a second copy of transfers that take longer than 95% of the previous ones
+    bool hedge;
+    // Directory the comic metadata gets cached in (NULL = the user's pref path)
+    const char* cache_dir;
+    // Seconds a stored comic is used without asking the server whether it changed
+    int metadata_ttl;
+    // Backend that performs the transfers: curl, file or fake
+    const char* transport;
+    // Where comics are fetched from, e.g. a local mirror of xkcd.com
+    const char* base_url;
+    // Directory the file transport serves canned responses from
+    const char* canned_dir;
+    // Average latency and share of failed transfers of the fake transport
+    int fake_latency_ms;
+    float fake_failure_rate;
+    // Number of threads decoding comic images (0 = all cores but two)
+    int decode_threads;
+    // Longest side in pixels comic images are downscaled to before they go into the texture atlas
+    int thumbnail_size;
+    // Seconds between two checks for a new comic (0 = never check)
+    int poll_interval;
+    // Number of tiles the newest comics wall shows
+    int newest_count;
+    // Run headless, download every comic that is not in the cache yet and exit
+    bool sync;
+    // Store the comic images in the cache too when syncing
+    bool sync_images;
+} config_t;
+
+extern config_t config;
+
+// Overrides the defaults with command line options of the form --name value
+bool config_parse(int argc, char* argv[]);
+
+#endif
@@ -0,0 +1,861 @@
+#include <SDL3/SDL.h>
+#include "fetch.h"
+#include "transport.h"
+#include "config.h"
+#include "histogram.h"
+#include "json.h"
+
+#define FETCH_POLL_TIMEOUT_MS 1000
+#define FETCH_TRANSFERS_PER_CORE 4
+#define FETCH_BUFFER_MIN_CAPACITY 4096
+// A transfer taking this many times the fastest recently seen one counts as a sign of congestion
+#define FETCH_CONGESTION_LATENCY_FACTOR 3.0f
+// How quickly the latency baseline drifts up towards what is observed, so it adapts to a slower upstream
+#define FETCH_BASELINE_DRIFT 0.02f
+// Hedging waits until the latency percentile it relies on is backed by enough transfers
+#define FETCH_HEDGE_MIN_SAMPLES 20
+#define FETCH_HEDGE_PERCENTILE 0.95f
+// Parsers kept around for reuse, enough for every transfer of a busy window
+#define FETCH_IDLE_PARSERS 64
+
+typedef struct {
+    fetch_job_t* head;
+    fetch_job_t* tail;
+} fetch_queue_t;
+
+static const fetch_transport_t* transports[] = { &transport_curl, &transport_file, &transport_fake };
+static const fetch_transport_t* transport = NULL;
+
+static SDL_Thread* thread = NULL;
+static SDL_Mutex* mutex = NULL;
+static SDL_AtomicInt quit;
+
+// Both queues are protected by the mutex
+static fetch_queue_t submitted = {0};
+static fetch_queue_t completed = {0};
+
+static Uint64 next_sequence = 0;
+static SDL_AtomicInt priorities_changed;
+static SDL_AtomicInt cancels_requested;
+
+// Only touched by the network thread (and by fetch_shutdown once it has stopped)
+static fetch_job_t* delayed = NULL; // Failed jobs waiting for their retry, linked through next
+static fetch_job_t* active = NULL;
+static int active_count = 0;
+static int max_transfers = 0;
+
+// Adaptive concurrency limit (AIMD) between 1 and max_transfers. It doubles every round trip until the
+// first sign of congestion, then grows by one per round trip and halves on failures or slow transfers
+static float limit = 1.0f;
+static bool slow_start = true;
+static Uint64 last_decrease = 0; // Transfers started before this tick do not decrease the limit again
+static float baseline_latency_ms = 0.0f;
+
+// Token bucket, a transfer can only start while there is a whole token
+static float tokens = 0.0f;
+static Uint64 tokens_updated = 0;
+
+// Snapshot of the limiter for fetch_get_stats
+static SDL_AtomicInt stats_limit;
+static SDL_AtomicInt stats_active;
+static SDL_AtomicInt stats_queued;
+static SDL_AtomicInt stats_throttled;
+static SDL_AtomicInt stats_retried;
+static SDL_AtomicInt stats_hedged;
+
+// Latency of every transfer phase in microseconds, protected by the mutex
+static histogram_t timings[fetch_phase_count];
+static const char* phase_names[fetch_phase_count] = { "lookup", "connect", "tls", "wait", "total" };
+
+// A push parser together with the decoder state its events go to
+typedef struct fetch_parser_s {
+    const fetch_decoder_t* decoder;
+    void* state;
+    struct json_stream_s* stream;
+} fetch_parser_t;
+
+// Parsers of finished JSON requests, later requests reuse them together with the buffers they have grown.
+// Protected by the mutex
+static fetch_parser_t* idle_parsers[FETCH_IDLE_PARSERS];
+static int num_idle_parsers = 0;
+
+// Binary max heap of jobs waiting for a free transfer slot
+static fetch_job_t** pending = NULL;
+static int pending_count = 0;
+static int pending_capacity = 0;
+
+static void queue_push(fetch_queue_t* queue, fetch_job_t* job) {
+    job->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = job;
+    }
+    else {
+        queue->head = job;
+    }
+    queue->tail = job;
+}
+
+static fetch_job_t* queue_take_all(fetch_queue_t* queue) {
+    fetch_job_t* head = queue->head;
+    queue->head = NULL;
+    queue->tail = NULL;
+    return head;
+}
+
+static bool heap_before(fetch_job_t* a, fetch_job_t* b) {
+    int priority_a = SDL_GetAtomicInt(&a->priority);
+    int priority_b = SDL_GetAtomicInt(&b->priority);
+    if (priority_a != priority_b) {
+        return priority_a > priority_b;
+    }
+    return a->sequence < b->sequence;
+}
+
+static void heap_sift_down(int index) {
+    for (;;) {
+        int best = index;
+        int left = index * 2 + 1;
+        int right = left + 1;
+        if (left < pending_count && heap_before(pending[left], pending[best])) {
+            best = left;
+        }
+        if (right < pending_count && heap_before(pending[right], pending[best])) {
+            best = right;
+        }
+        if (best == index) {
+            return;
+        }
+        fetch_job_t* temp = pending[index];
+        pending[index] = pending[best];
+        pending[best] = temp;
+        index = best;
+    }
+}
+
+static void heap_push(fetch_job_t* job) {
+    if (pending_count == pending_capacity) {
+        pending_capacity = pending_capacity ? pending_capacity * 2 : 64;
+        pending = (fetch_job_t**) SDL_realloc(pending, sizeof(fetch_job_t*) * pending_capacity);
+    }
+    int index = pending_count++;
+    pending[index] = job;
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!heap_before(pending[index], pending[parent])) {
+            break;
+        }
+        fetch_job_t* temp = pending[index];
+        pending[index] = pending[parent];
+        pending[parent] = temp;
+        index = parent;
+    }
+}
+
+static fetch_job_t* heap_pop(void) {
+    fetch_job_t* top = pending[0];
+    pending[0] = pending[--pending_count];
+    heap_sift_down(0);
+    return top;
+}
+
+// Priorities changed behind the heap's back, restore the heap property
+static void heap_rebuild(void) {
+    for (int i = pending_count / 2 - 1; i >= 0; i--) {
+        heap_sift_down(i);
+    }
+}
+
+static void active_add(fetch_job_t* job) {
+    job->running = true;
+    job->active_prev = NULL;
+    job->active_next = active;
+    if (active) {
+        active->active_prev = job;
+    }
+    active = job;
+    active_count++;
+}
+
+static void active_remove(fetch_job_t* job) {
+    if (job->active_prev) {
+        job->active_prev->active_next = job->active_next;
+    }
+    else {
+        active = job->active_next;
+    }
+    if (job->active_next) {
+        job->active_next->active_prev = job->active_prev;
+    }
+    job->active_prev = NULL;
+    job->active_next = NULL;
+    job->running = false;
+    active_count--;
+}
+
+static void destroy_parser(fetch_parser_t* parser) {
+    if (parser == NULL) {
+        return;
+    }
+    json_stream_destroy(parser->stream);
+    if (parser->state) {
+        parser->decoder->destroy(parser->state);
+    }
+    SDL_free(parser);
+}
+
+static fetch_parser_t* take_parser(const fetch_decoder_t* decoder) {
+    fetch_parser_t* parser = NULL;
+    SDL_LockMutex(mutex);
+    for (int i = num_idle_parsers - 1; i >= 0; i--) {
+        if (idle_parsers[i]->decoder == decoder) {
+            parser = idle_parsers[i];
+            idle_parsers[i] = idle_parsers[--num_idle_parsers];
+            break;
+        }
+    }
+    SDL_UnlockMutex(mutex);
+    if (parser) {
+        return parser;
+    }
+    parser = (fetch_parser_t*) SDL_calloc(1, sizeof(fetch_parser_t));
+    if (parser == NULL) {
+        return NULL;
+    }
+    parser->decoder = decoder;
+    parser->state = decoder->create();
+    parser->stream = parser->state ? json_stream_create(decoder->event, parser->state) : NULL;
+    if (parser->stream == NULL) {
+        SDL_Log("ERROR could not create a JSON parser");
+        destroy_parser(parser);
+        return NULL;
+    }
+    return parser;
+}
+
+static void reset_parser(fetch_parser_t* parser) {
+    json_stream_reset(parser->stream);
+    parser->decoder->reset(parser->state);
+}
+
+static void give_back_parser(fetch_parser_t* parser) {
+    if (parser == NULL) {
+        return;
+    }
+    reset_parser(parser);
+    SDL_LockMutex(mutex);
+    if (num_idle_parsers < FETCH_IDLE_PARSERS) {
+        idle_parsers[num_idle_parsers++] = parser;
+        parser = NULL;
+    }
+    SDL_UnlockMutex(mutex);
+    destroy_parser(parser);
+}
+
+static void free_job(fetch_job_t* job) {
+    for (int i = 0; job->headers && job->headers[i]; i++) {
+        SDL_free(job->headers[i]);
+    }
+    SDL_free(job->headers);
+    SDL_free(job->body.data);
+    give_back_parser(job->parser);
+    SDL_free(job->etag);
+    SDL_free(job->last_modified);
+    SDL_free(job->url);
+    SDL_free(job);
+}
+
+bool fetch_reserve_body(fetch_job_t* job, size_t capacity) {
+    fetch_buffer_t* body = &job->body;
+    // A streamed body is decoded instead of collected, there is nothing to reserve
+    if (job->parser || capacity <= body->capacity) {
+        return true;
+    }
+    char* data = (char*) SDL_realloc(body->data, capacity);
+    if (data == NULL) {
+        return false;
+    }
+    body->data = data;
+    body->capacity = capacity;
+    return true;
+}
+
+bool fetch_append_body(fetch_job_t* job, const void* data, size_t size) {
+    if (job->parser) {
+        // Invalid JSON is not a transfer error, the status of e.g. a 404 still has to come through
+        json_stream_feed(job->parser->stream, data, size);
+        return true;
+    }
+    fetch_buffer_t* body = &job->body;
+    // Always keep room for the null terminator
+    size_t needed = body->size + size + 1;
+    if (needed > body->capacity) {
+        size_t capacity = body->capacity ? body->capacity * 2 : FETCH_BUFFER_MIN_CAPACITY;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        if (!fetch_reserve_body(job, capacity)) {
+            return false;
+        }
+    }
+    SDL_memcpy(body->data + body->size, data, size);
+    body->size += size;
+    body->data[body->size] = '\0';
+    return true;
+}
+
+static void stop_transfer(fetch_job_t* job) {
+    if (job->running) {
+        transport->abort(job);
+        job->transport_data = NULL;
+        active_remove(job);
+    }
+}
+
+// Stops and frees a job together with its hedge
+static void drop_job(fetch_job_t* job) {
+    if (job->hedge) {
+        stop_transfer(job->hedge);
+        free_job(job->hedge);
+    }
+    stop_transfer(job);
+    free_job(job);
+}
+
+// Frees cancelled jobs that are still waiting or running, the ones that already completed are dropped by fetch_dispatch
+static void drop_cancelled(void) {
+    fetch_job_t** link = &delayed;
+    while (*link) {
+        fetch_job_t* job = *link;
+        if (SDL_GetAtomicInt(&job->cancelled)) {
+            *link = job->next;
+            free_job(job);
+        }
+        else {
+            link = &job->next;
+        }
+    }
+    int kept = 0;
+    for (int i = 0; i < pending_count; i++) {
+        if (SDL_GetAtomicInt(&pending[i]->cancelled)) {
+            free_job(pending[i]);
+        }
+        else {
+            pending[kept++] = pending[i];
+        }
+    }
+    pending_count = kept;
+    heap_rebuild();
+    // Dropping a job can take its hedge out of the list as well, so start over after every drop
+    bool dropped = true;
+    while (dropped) {
+        dropped = false;
+        for (fetch_job_t* job = active; job; job = job->active_next) {
+            fetch_job_t* primary = job->hedge_of ? job->hedge_of : job;
+            if (SDL_GetAtomicInt(&primary->cancelled)) {
+                drop_job(primary);
+                dropped = true;
+                break;
+            }
+        }
+    }
+}
+
+static void refill_tokens(void) {
+    Uint64 now = SDL_GetTicks();
+    float rate = config.rate_limit;
+    // Allows a burst of up to one second worth of requests after an idle period
+    float burst = SDL_max(rate, 1.0f);
+    tokens = SDL_min(tokens + (now - tokens_updated) * 0.001f * rate, burst);
+    tokens_updated = now;
+}
+
+static bool take_token(void) {
+    if (config.rate_limit <= 0.0f) {
+        return true;
+    }
+    refill_tokens();
+    if (tokens < 1.0f) {
+        return false;
+    }
+    tokens -= 1.0f;
+    return true;
+}
+
+// Milliseconds until the next token is available
+static int token_wait_ms(void) {
+    if (config.rate_limit <= 0.0f || tokens >= 1.0f) {
+        return 0;
+    }
+    return (int) SDL_ceilf((1.0f - tokens) * 1000.0f / config.rate_limit);
+}
+
+// The upstream is overloaded, unreachable or told us to back off, as opposed to a request that simply
+// failed (like a 404). These failures are worth retrying and a sign of congestion
+// A timeout counts even if the response had started, a stalled body is as good as none
+static bool is_transient_failure(bool ok, long status, bool timed_out) {
+    return (!ok && (status == 0 || timed_out)) || status == 429 || status >= 500;
+}
+
+static void adjust_limit(fetch_job_t* job, bool ok, long status) {
+    Uint64 now = SDL_GetTicks();
+    float latency_ms = (float) (now - job->started_at);
+    if (baseline_latency_ms <= 0.0f || latency_ms < baseline_latency_ms) {
+        baseline_latency_ms = latency_ms;
+    }
+    else {
+        baseline_latency_ms += (latency_ms - baseline_latency_ms) * FETCH_BASELINE_DRIFT;
+    }
+    bool slow = latency_ms > SDL_max(baseline_latency_ms, 1.0f) * FETCH_CONGESTION_LATENCY_FACTOR;
+    if (is_transient_failure(ok, status, job->timed_out) || slow) {
+        // One decrease per round trip, the other transfers of the same window saw the same congestion
+        if (job->started_at >= last_decrease) {
+            limit = SDL_max(limit * 0.5f, 1.0f);
+            slow_start = false;
+            last_decrease = now;
+            SDL_AddAtomicInt(&stats_throttled, 1);
+        }
+        if (status == 429 || status == 503) {
+            // Give the upstream a moment before the bucket allows the next request
+            tokens = SDL_min(tokens, 0.0f);
+        }
+    }
+    else {
+        limit += slow_start ? 1.0f : 1.0f / limit;
+        limit = SDL_min(limit, (float) max_transfers);
+    }
+}
+
+// Backoff doubles with every attempt, half of it is random so retries of a burst of failures spread out
+static void schedule_retry(fetch_job_t* job) {
+    Uint64 backoff = (Uint64) config.retry_delay_ms << SDL_min(job->attempt, 16);
+    Uint64 delay = backoff / 2 + (Uint64) (SDL_randf() * (backoff / 2));
+    job->attempt++;
+    job->due = SDL_GetTicks() + delay;
+    job->hedged = false;
+    job->timed_out = false;
+    // Forget the failed response
+    job->body.size = 0;
+    if (job->parser) {
+        reset_parser(job->parser);
+    }
+    SDL_free(job->etag);
+    SDL_free(job->last_modified);
+    job->etag = NULL;
+    job->last_modified = NULL;
+    SDL_memset(job->phase_us, 0, sizeof(job->phase_us));
+    job->next = delayed;
+    delayed = job;
+    SDL_AddAtomicInt(&stats_retried, 1);
+}
+
+static void finish_job(fetch_job_t* job) {
+    bool retry = is_transient_failure(job->ok, job->status, job->timed_out) && job->attempt < config.max_retries;
+    if (retry && !SDL_GetAtomicInt(&job->cancelled)) {
+        schedule_retry(job);
+        return;
+    }
+    SDL_LockMutex(mutex);
+    queue_push(&completed, job);
+    SDL_UnlockMutex(mutex);
+}
+
+// Hands the response of the hedge over to the job it was made for
+static void take_response(fetch_job_t* job, fetch_job_t* hedge) {
+    fetch_buffer_t body = job->body;
+    job->body = hedge->body;
+    hedge->body = body;
+    fetch_parser_t* parser = job->parser;
+    job->parser = hedge->parser;
+    hedge->parser = parser;
+    SDL_free(job->etag);
+    SDL_free(job->last_modified);
+    job->etag = hedge->etag;
+    job->last_modified = hedge->last_modified;
+    hedge->etag = NULL;
+    hedge->last_modified = NULL;
+    job->ok = hedge->ok;
+    job->status = hedge->status;
+    job->timed_out = hedge->timed_out;
+}
+
+void fetch_complete(fetch_job_t* job, bool ok, long status) {
+    adjust_limit(job, ok, status);
+    job->ok = ok;
+    job->status = status;
+    job->transport_data = NULL;
+    active_remove(job);
+    // Transports that cannot tell the phases apart at least get the total
+    if (job->phase_us[fetch_phase_total] == 0) {
+        job->phase_us[fetch_phase_total] = (SDL_GetTicks() - job->started_at) * 1000;
+    }
+    SDL_LockMutex(mutex);
+    for (int i = 0; i < fetch_phase_count; i++) {
+        if (job->phase_us[i] > 0 || i == fetch_phase_total) {
+            histogram_add(&timings[i], job->phase_us[i]);
+        }
+    }
+    SDL_UnlockMutex(mutex);
+
+    fetch_job_t* primary = job->hedge_of ? job->hedge_of : job;
+    fetch_job_t* other = job->hedge_of ? job->hedge_of : job->hedge;
+    if (other && other->running) {
+        if (is_transient_failure(ok, status, job->timed_out)) {
+            // The other copy might still get an answer, wait for it
+            if (job != primary) {
+                primary->hedge = NULL;
+                free_job(job);
+            }
+            return;
+        }
+        stop_transfer(other);
+    }
+    if (job != primary) {
+        take_response(primary, job);
+        free_job(job);
+    }
+    else if (primary->hedge) {
+        free_job(primary->hedge);
+    }
+    primary->hedge = NULL;
+    finish_job(primary);
+}
+
+// Latency after which a transfer gets a hedge, 0 while hedging is off or there are too few samples
+static Uint64 hedge_after_ms(void) {
+    if (!config.hedge) {
+        return 0;
+    }
+    SDL_LockMutex(mutex);
+    const histogram_t* total = &timings[fetch_phase_total];
+    Uint64 result = 0;
+    if (total->count >= FETCH_HEDGE_MIN_SAMPLES) {
+        result = SDL_max(histogram_percentile(total, FETCH_HEDGE_PERCENTILE) / 1000, 1);
+    }
+    SDL_UnlockMutex(mutex);
+    return result;
+}
+
+static fetch_job_t* copy_job(fetch_job_t* job) {
+    fetch_job_t* copy = (fetch_job_t*) SDL_calloc(1, sizeof(fetch_job_t));
+    copy->url = SDL_strdup(job->url);
+    int num_headers = 0;
+    while (job->headers[num_headers]) {
+        num_headers++;
+    }
+    copy->headers = (char**) SDL_calloc(num_headers + 1, sizeof(char*));
+    for (int i = 0; i < num_headers; i++) {
+        copy->headers[i] = SDL_strdup(job->headers[i]);
+    }
+    copy->decoder = job->decoder;
+    if (job->decoder) {
+        copy->parser = take_parser(job->decoder);
+    }
+    SDL_SetAtomicInt(&copy->priority, SDL_GetAtomicInt(&job->priority));
+    copy->sequence = job->sequence;
+    return copy;
+}
+
+// Starts a copy of every transfer that runs longer than the hedging percentile, returns how long until
+// the next one is due
+static int start_hedges(void) {
+    Uint64 after_ms = hedge_after_ms();
+    if (after_ms == 0) {
+        return FETCH_POLL_TIMEOUT_MS;
+    }
+    int timeout_ms = FETCH_POLL_TIMEOUT_MS;
+    Uint64 now = SDL_GetTicks();
+    // New copies go to the front of the list, so they are not visited again
+    for (fetch_job_t* job = active; job; job = job->active_next) {
+        if (job->hedge_of || job->hedged) {
+            continue;
+        }
+        Uint64 elapsed = now - job->started_at;
+        if (elapsed < after_ms) {
+            timeout_ms = SDL_min(timeout_ms, (int) (after_ms - elapsed));
+            continue;
+        }
+        // Hedges count against the concurrency limit and the rate limit like every other transfer
+        if (active_count >= (int) limit || !take_token()) {
+            continue;
+        }
+        job->hedged = true;
+        fetch_job_t* hedge = copy_job(job);
+        hedge->hedge_of = job;
+        hedge->started_at = now;
+        job->hedge = hedge;
+        active_add(hedge);
+        SDL_AddAtomicInt(&stats_hedged, 1);
+        transport->start(hedge);
+    }
+    return timeout_ms;
+}
+
+// Moves retries whose backoff is over back into the heap, returns how long until the next one is due
+static int release_delayed(void) {
+    int timeout_ms = FETCH_POLL_TIMEOUT_MS;
+    Uint64 now = SDL_GetTicks();
+    fetch_job_t** link = &delayed;
+    while (*link) {
+        fetch_job_t* job = *link;
+        if (job->due <= now) {
+            *link = job->next;
+            heap_push(job);
+        }
+        else {
+            timeout_ms = SDL_min(timeout_ms, (int) (job->due - now));
+            link = &job->next;
+        }
+    }
+    return timeout_ms;
+}
+
+static int fetch_thread(void* data) {
+    (void) data;
+    while (!SDL_GetAtomicInt(&quit)) {
+        SDL_LockMutex(mutex);
+        fetch_job_t* job = queue_take_all(&submitted);
+        SDL_UnlockMutex(mutex);
+        while (job) {
+            fetch_job_t* next = job->next;
+            heap_push(job);
+            job = next;
+        }
+        int timeout_ms = release_delayed();
+        if (SDL_SetAtomicInt(&cancels_requested, 0)) {
+            drop_cancelled();
+        }
+        else if (SDL_SetAtomicInt(&priorities_changed, 0)) {
+            heap_rebuild();
+        }
+        // Only a bounded number of transfers run at once and only as many start per second as the
+        // rate limit allows, the most important ones go first
+        while (active_count < (int) limit && pending_count > 0 && take_token()) {
+            job = heap_pop();
+            // Cancelled while it was still on its way into the heap
+            if (SDL_GetAtomicInt(&job->cancelled)) {
+                tokens += 1.0f;
+                free_job(job);
+                continue;
+            }
+            // Decodes the chunks as they arrive, so the body is never collected. Only running transfers
+            // hold a parser, however many requests are queued
+            if (job->decoder && job->parser == NULL) {
+                job->parser = take_parser(job->decoder);
+            }
+            job->started_at = SDL_GetTicks();
+            active_add(job);
+            transport->start(job);
+        }
+        timeout_ms = SDL_min(timeout_ms, start_hedges());
+        SDL_SetAtomicInt(&stats_limit, (int) limit);
+        SDL_SetAtomicInt(&stats_active, active_count);
+        SDL_SetAtomicInt(&stats_queued, pending_count);
+
+        // Sleeps until a transfer makes progress or fetch_submit wakes us up, unless transfers that
+        // completed right away left room for more. Waiting for a token, a retry or a hedge cuts the
+        // sleep short
+        if (active_count < (int) limit && pending_count > 0) {
+            timeout_ms = SDL_min(timeout_ms, token_wait_ms());
+        }
+        transport->poll(timeout_ms);
+    }
+    return 0;
+}
+
+bool fetch_init(void) {
+    for (size_t i = 0; i < SDL_arraysize(transports); i++) {
+        if (SDL_strcmp(config.transport, transports[i]->name) == 0) {
+            transport = transports[i];
+        }
+    }
+    if (transport == NULL) {
+        SDL_Log("Unknown transport '%s'", config.transport);
+        return false;
+    }
+    if (!transport->init()) {
+        return false;
+    }
+    mutex = SDL_CreateMutex();
+    if (mutex == NULL) {
+        SDL_Log("Could not create fetch mutex: '%s'\n", SDL_GetError());
+        return false;
+    }
+    max_transfers = config.max_transfers;
+    if (max_transfers <= 0) {
+        max_transfers = SDL_GetNumLogicalCPUCores() * FETCH_TRANSFERS_PER_CORE;
+    }
+    SDL_SetAtomicInt(&quit, 0);
+    SDL_SetAtomicInt(&priorities_changed, 0);
+    SDL_SetAtomicInt(&cancels_requested, 0);
+    SDL_SetAtomicInt(&stats_throttled, 0);
+    SDL_SetAtomicInt(&stats_retried, 0);
+    SDL_SetAtomicInt(&stats_hedged, 0);
+    // Start small, slow start finds the upstream's capacity within a few round trips
+    limit = SDL_min((float) max_transfers, 2.0f);
+    slow_start = true;
+    last_decrease = 0;
+    baseline_latency_ms = 0.0f;
+    tokens = SDL_max(config.rate_limit, 1.0f);
+    tokens_updated = SDL_GetTicks();
+    thread = SDL_CreateThread(fetch_thread, "fetch_thread", NULL);
+    if (thread == NULL) {
+        SDL_Log("Could not create fetch thread: '%s'\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+static fetch_job_t* submit_job(const char* url, const char* const* headers, int priority, const fetch_decoder_t* decoder, fetch_done_func done, void* data) {
+    fetch_job_t* job = (fetch_job_t*) SDL_calloc(1, sizeof(fetch_job_t));
+    job->decoder = decoder;
+    job->url = SDL_strdup(url);
+    int num_headers = 0;
+    while (headers && headers[num_headers]) {
+        num_headers++;
+    }
+    job->headers = (char**) SDL_calloc(num_headers + 1, sizeof(char*));
+    for (int i = 0; i < num_headers; i++) {
+        job->headers[i] = SDL_strdup(headers[i]);
+    }
+    job->done = done;
+    job->data = data;
+    SDL_SetAtomicInt(&job->priority, priority);
+    SDL_LockMutex(mutex);
+    job->sequence = next_sequence++;
+    queue_push(&submitted, job);
+    SDL_UnlockMutex(mutex);
+    transport->wakeup();
+    return job;
+}
+
+fetch_job_t* fetch_submit(const char* url, const char* const* headers, int priority, fetch_done_func done, void* data) {
+    return submit_job(url, headers, priority, NULL, done, data);
+}
+
+fetch_job_t* fetch_submit_json(const char* url, const char* const* headers, int priority, const fetch_decoder_t* decoder, fetch_done_func done, void* data) {
+    return submit_job(url, headers, priority, decoder, done, data);
+}
+
+void fetch_set_priority(fetch_job_t* job, int priority) {
+    if (SDL_SetAtomicInt(&job->priority, priority) != priority) {
+        SDL_SetAtomicInt(&priorities_changed, 1);
+        transport->wakeup();
+    }
+}
+
+void fetch_cancel(fetch_job_t* job) {
+    SDL_SetAtomicInt(&job->cancelled, 1);
+    SDL_SetAtomicInt(&cancels_requested, 1);
+    transport->wakeup();
+}
+
+void fetch_get_stats(fetch_stats_t* stats) {
+    stats->limit = SDL_GetAtomicInt(&stats_limit);
+    stats->active = SDL_GetAtomicInt(&stats_active);
+    stats->queued = SDL_GetAtomicInt(&stats_queued);
+    stats->throttled = SDL_GetAtomicInt(&stats_throttled);
+    stats->retried = SDL_GetAtomicInt(&stats_retried);
+    stats->hedged = SDL_GetAtomicInt(&stats_hedged);
+}
+
+void fetch_log_timings(void) {
+    histogram_t snapshot[fetch_phase_count];
+    SDL_LockMutex(mutex);
+    SDL_memcpy(snapshot, timings, sizeof(snapshot));
+    SDL_UnlockMutex(mutex);
+    if (snapshot[fetch_phase_total].count == 0) {
+        return;
+    }
+    SDL_Log("%-8s %8s %10s %10s %10s %10s %10s", "phase", "count", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    for (int i = 0; i < fetch_phase_count; i++) {
+        const histogram_t* histogram = &snapshot[i];
+        double mean = histogram->count ? (double) histogram->sum / histogram->count : 0.0;
+        SDL_Log("%-8s %8llu %10.2f %10.2f %10.2f %10.2f %10.2f", phase_names[i], (unsigned long long) histogram->count,
+            mean * 0.001,
+            histogram_percentile(histogram, 0.5f) * 0.001,
+            histogram_percentile(histogram, 0.9f) * 0.001,
+            histogram_percentile(histogram, 0.99f) * 0.001,
+            histogram->max * 0.001);
+    }
+}
+
+void fetch_dispatch(void) {
+    SDL_LockMutex(mutex);
+    fetch_job_t* job = queue_take_all(&completed);
+    SDL_UnlockMutex(mutex);
+    while (job) {
+        fetch_job_t* next = job->next;
+        if (job->done && !SDL_GetAtomicInt(&job->cancelled)) {
+            void* decoded = NULL;
+            if (job->parser) {
+                struct json_parse_result_s result;
+                json_stream_finish(job->parser->stream, &result);
+                if (result.error == json_parse_error_none) {
+                    decoded = job->parser->state;
+                }
+            }
+            fetch_response_t response = {
+                .ok = job->ok,
+                .status = job->status,
+                // An empty response (e.g. 304 Not Modified) still hands out a valid string
+                .body = job->body.data ? job->body.data : "",
+                .size = job->body.size,
+                .decoded = decoded,
+                .etag = job->etag,
+                .last_modified = job->last_modified
+            };
+            job->done(&response, job->data);
+        }
+        free_job(job);
+        job = next;
+    }
+}
+
+void fetch_shutdown(void) {
+    if (thread) {
+        SDL_SetAtomicInt(&quit, 1);
+        transport->wakeup();
+        SDL_WaitThread(thread, NULL);
+        thread = NULL;
+    }
+    // Drop whatever is still in flight or queued
+    while (active) {
+        drop_job(active->hedge_of ? active->hedge_of : active);
+    }
+    while (delayed) {
+        fetch_job_t* next = delayed->next;
+        free_job(delayed);
+        delayed = next;
+    }
+    for (int i = 0; i < pending_count; i++) {
+        free_job(pending[i]);
+    }
+    SDL_free(pending);
+    pending = NULL;
+    pending_count = 0;
+    pending_capacity = 0;
+    fetch_job_t* job = queue_take_all(&submitted);
+    while (job) {
+        fetch_job_t* next = job->next;
+        free_job(job);
+        job = next;
+    }
+    job = queue_take_all(&completed);
+    while (job) {
+        fetch_job_t* next = job->next;
+        free_job(job);
+        job = next;
+    }
+    for (int i = 0; i < num_idle_parsers; i++) {
+        destroy_parser(idle_parsers[i]);
+    }
+    num_idle_parsers = 0;
+    if (transport) {
+        transport->shutdown();
+        transport = NULL;
+    }
+    if (mutex) {
+        SDL_DestroyMutex(mutex);
+        mutex = NULL;
+    }
+}
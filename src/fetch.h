@@ -0,0 +1,89 @@
+#ifndef FETCH_H
+#define FETCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "json.h"
+
+typedef struct fetch_job_s fetch_job_t;
+
+// Turns a JSON body into whatever the caller needs while it downloads. Every running transfer gets a state
+// of its own, and states are reused for later transfers once their response has been dispatched
+typedef struct fetch_decoder_s {
+    void* (*create)(void);
+    void (*reset)(void* state); // Forget the previous body
+    void (*destroy)(void* state);
+    json_stream_callback_t event; // Called on the network thread with the state as user_data
+} fetch_decoder_t;
+
+typedef struct {
+    bool ok; // The transfer succeeded and the server did not answer with an HTTP error
+    long status; // HTTP status code, 0 if no response arrived
+    const char* body; // The complete response body, null terminated. Empty for fetch_submit_json
+    size_t size;
+    void* decoded; // fetch_submit_json only, the decoder state or NULL if the body was not valid JSON
+    const char* etag; // Validators sent by the server, NULL if missing
+    const char* last_modified;
+} fetch_response_t;
+
+// Phases of a transfer, as reported by curl. The connection phases are skipped when a connection is reused
+typedef enum {
+    fetch_phase_lookup, // Name resolution
+    fetch_phase_connect, // TCP handshake
+    fetch_phase_tls, // TLS handshake
+    fetch_phase_wait, // Request sent until the first byte of the response arrived
+    fetch_phase_total, // The whole transfer including the download of the body
+    fetch_phase_count
+} fetch_phase;
+
+typedef struct {
+    int limit; // Current number of transfers allowed to run at once
+    int active;
+    int queued; // Requests waiting for a transfer slot or a token
+    int throttled; // How often the limit was cut because the upstream struggled
+    int retried; // Transfers that failed and were tried again
+    int hedged; // Slow transfers that got a second copy
+} fetch_stats_t;
+
+// Called on the main thread (from fetch_dispatch) once the transfer has finished, retries included.
+// Everything the response points to is freed after the callback returns
+typedef void (*fetch_done_func)(const fetch_response_t* response, void* data);
+
+// Starts the network thread which drives every request through the configured transport. It starts at
+// most config.rate_limit requests per second and adapts the number of concurrent transfers to how well
+// the upstream copes, never running more than config.max_transfers at once.
+// Transient failures are retried up to config.max_retries times with exponential backoff, and with
+// config.hedge a transfer that takes longer than 95% of the previous ones gets a second copy
+bool fetch_init(void);
+
+// Queue a request, can be called from any thread. Requests with a higher priority start first.
+// headers is an optional NULL terminated list of extra request headers ("Name: value").
+// The returned job stays valid until its done callback has run
+fetch_job_t* fetch_submit(const char* url, const char* const* headers, int priority, fetch_done_func done, void* data);
+
+// Like fetch_submit, but the body is fed to the decoder on the network thread chunk by chunk while it
+// downloads and handed over as response->decoded instead of as text
+fetch_job_t* fetch_submit_json(const char* url, const char* const* headers, int priority, const fetch_decoder_t* decoder, fetch_done_func done, void* data);
+
+// Move a queued request up or down the queue, has no effect once the transfer has started
+void fetch_set_priority(fetch_job_t* job, int priority);
+
+// Drop a request, call on the main thread before its done callback has run. A queued request never
+// starts and a running transfer is aborted. The done callback is never called and the job must not be
+// touched afterwards
+void fetch_cancel(fetch_job_t* job);
+
+// Current state of the rate limiter, can be called from any thread
+void fetch_get_stats(fetch_stats_t* stats);
+
+// Logs latency percentiles of every phase over all transfers so far, can be called from any thread
+void fetch_log_timings(void);
+
+// Run the done callbacks of all finished requests, call once per frame on the main thread
+void fetch_dispatch(void);
+
+// Stops the network thread and drops all outstanding requests
+void fetch_shutdown(void);
+
+#endif
@@ -0,0 +1,47 @@
+#include "histogram.h"
+
+static int bucket_of(Uint64 value) {
+    if (value < 4) {
+        return (int) value;
+    }
+    if (value > SDL_MAX_UINT32) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    // The two bits below the highest one pick one of four buckets within the power of two
+    int exponent = SDL_MostSignificantBitIndex32((Uint32) value);
+    int sub_bucket = (int) (value >> (exponent - 2)) & 3;
+    return (exponent - 1) * 4 + sub_bucket;
+}
+
+static Uint64 bucket_upper_bound(int bucket) {
+    if (bucket < 4) {
+        return (Uint64) bucket;
+    }
+    int exponent = bucket / 4 + 1;
+    int sub_bucket = bucket % 4;
+    Uint64 lower = (Uint64) (4 + sub_bucket) << (exponent - 2);
+    return lower + ((Uint64) 1 << (exponent - 2)) - 1;
+}
+
+void histogram_add(histogram_t* histogram, Uint64 value) {
+    histogram->buckets[bucket_of(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+    histogram->max = SDL_max(histogram->max, value);
+}
+
+Uint64 histogram_percentile(const histogram_t* histogram, float percentile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+    Uint64 rank = (Uint64) SDL_ceilf(percentile * (float) histogram->count);
+    rank = SDL_clamp(rank, 1, histogram->count);
+    Uint64 seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            return SDL_min(bucket_upper_bound(i), histogram->max);
+        }
+    }
+    return histogram->max;
+}
@@ -0,0 +1,22 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <SDL3/SDL.h>
+
+// Four buckets per power of two, so every bucket is at most 25% wide and 2^32 is the largest value kept apart
+#define HISTOGRAM_BUCKETS 128
+
+// Log-linear histogram of non-negative values (e.g. latencies in microseconds), fixed size and allocation free
+typedef struct {
+    Uint64 count;
+    Uint64 sum;
+    Uint64 max;
+    Uint32 buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+void histogram_add(histogram_t* histogram, Uint64 value);
+
+// Upper bound of the bucket the given share (0 to 1) of values falls into, 0 for an empty histogram
+Uint64 histogram_percentile(const histogram_t* histogram, float percentile);
+
+#endif
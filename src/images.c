@@ -0,0 +1,318 @@
+#include <SDL3/SDL.h>
+#include <SDL3_image/SDL_image.h>
+#include "images.h"
+#include "atlas.h"
+#include "fetch.h"
+#include "config.h"
+#include "store.h"
+
+// Uploading into the atlas stalls the frame, so only a few thumbnails go in per frame
+#define IMAGE_UPLOADS_PER_FRAME 4
+
+typedef enum {
+    image_state_none,
+    image_state_fetching,
+    image_state_decoding,
+    image_state_ready,
+    image_state_failed
+} image_state;
+
+typedef struct {
+    image_state state;
+    int refs; // Number of tiles showing the image, its atlas space is given back once this drops to zero
+    fetch_job_t* job; // Set while the image is being fetched
+    atlas_region_t region; // Valid while the image is ready
+} image_t;
+
+// Encoded bytes on the way to a worker, or a decoded thumbnail on the way back
+typedef struct decode_job_s {
+    int xkcd_number;
+    void* data;
+    size_t size;
+    SDL_Surface* surface;
+    struct decode_job_s* next;
+} decode_job_t;
+
+typedef struct {
+    decode_job_t* head;
+    decode_job_t* tail;
+} decode_queue_t;
+
+// Indexed by comic number, only touched by the main thread
+static image_t* images = NULL;
+static int images_capacity = 0;
+
+static SDL_Thread** workers = NULL;
+static int num_workers = 0;
+static SDL_Mutex* mutex = NULL;
+static SDL_Condition* work_available = NULL;
+static bool quit = false;
+
+// Both queues are protected by the mutex
+static decode_queue_t to_decode = {0};
+static decode_queue_t decoded = {0};
+
+static void queue_push(decode_queue_t* queue, decode_job_t* job) {
+    job->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = job;
+    }
+    else {
+        queue->head = job;
+    }
+    queue->tail = job;
+}
+
+static decode_job_t* queue_pop(decode_queue_t* queue) {
+    decode_job_t* job = queue->head;
+    if (job) {
+        queue->head = job->next;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+    }
+    return job;
+}
+
+static void free_decode_job(decode_job_t* job) {
+    SDL_free(job->data);
+    SDL_DestroySurface(job->surface);
+    SDL_free(job);
+}
+
+static image_t* image_at(int xkcd_number) {
+    if (xkcd_number < 0) {
+        return NULL;
+    }
+    if (xkcd_number >= images_capacity) {
+        int capacity = images_capacity ? images_capacity : 1024;
+        while (capacity <= xkcd_number) {
+            capacity *= 2;
+        }
+        images = (image_t*) SDL_realloc(images, sizeof(image_t) * capacity);
+        SDL_memset(images + images_capacity, 0, sizeof(image_t) * (capacity - images_capacity));
+        images_capacity = capacity;
+    }
+    return &images[xkcd_number];
+}
+
+// Converts into the atlas format and scales down to config.thumbnail_size
+static SDL_Surface* make_thumbnail(SDL_Surface* surface) {
+    SDL_Surface* converted = SDL_ConvertSurface(surface, SDL_PIXELFORMAT_RGBA32);
+    int longest = SDL_max(surface->w, surface->h);
+    if (converted == NULL || longest <= config.thumbnail_size) {
+        return converted;
+    }
+    float scale = (float) config.thumbnail_size / longest;
+    int w = SDL_max(1, (int) SDL_roundf(surface->w * scale));
+    int h = SDL_max(1, (int) SDL_roundf(surface->h * scale));
+    SDL_Surface* scaled = SDL_ScaleSurface(converted, w, h, SDL_SCALEMODE_LINEAR);
+    SDL_DestroySurface(converted);
+    return scaled;
+}
+
+// Decoding, conversion and scaling all happen here, off the render thread
+static int decode_worker(void* data) {
+    (void) data;
+    SDL_LockMutex(mutex);
+    while (!quit) {
+        decode_job_t* job = queue_pop(&to_decode);
+        if (job == NULL) {
+            SDL_WaitCondition(work_available, mutex);
+            continue;
+        }
+        SDL_UnlockMutex(mutex);
+
+        SDL_Surface* surface = IMG_Load_IO(SDL_IOFromConstMem(job->data, job->size), true);
+        if (surface) {
+            job->surface = make_thumbnail(surface);
+            SDL_DestroySurface(surface);
+        }
+        if (job->surface == NULL) {
+            SDL_Log("ERROR in decoding image of xkcd %d: '%s'", job->xkcd_number, SDL_GetError());
+        }
+        SDL_free(job->data);
+        job->data = NULL;
+
+        SDL_LockMutex(mutex);
+        queue_push(&decoded, job);
+    }
+    SDL_UnlockMutex(mutex);
+    return 0;
+}
+
+// The worker gets its own copy of the encoded bytes
+static void queue_decode(int xkcd_number, const void* data, size_t size) {
+    decode_job_t* job = (decode_job_t*) SDL_calloc(1, sizeof(decode_job_t));
+    job->xkcd_number = xkcd_number;
+    job->data = SDL_malloc(size);
+    job->size = size;
+    SDL_memcpy(job->data, data, size);
+    image_at(xkcd_number)->state = image_state_decoding;
+    SDL_LockMutex(mutex);
+    queue_push(&to_decode, job);
+    SDL_SignalCondition(work_available);
+    SDL_UnlockMutex(mutex);
+}
+
+static void image_fetched(const fetch_response_t* response, void* data) {
+    int xkcd_number = (int) (intptr_t) data;
+    image_t* image = image_at(xkcd_number);
+    image->job = NULL;
+    if (!response->ok || response->size == 0) {
+        SDL_Log("ERROR in fetching image of xkcd %d", xkcd_number);
+        image->state = image_state_failed;
+        return;
+    }
+    queue_decode(xkcd_number, response->body, response->size);
+}
+
+bool images_init(SDL_Renderer* renderer) {
+    if (!atlas_init(renderer)) {
+        return false;
+    }
+    mutex = SDL_CreateMutex();
+    work_available = SDL_CreateCondition();
+    if (mutex == NULL || work_available == NULL) {
+        SDL_Log("Could not create decode queue: '%s'\n", SDL_GetError());
+        return false;
+    }
+    num_workers = config.decode_threads;
+    if (num_workers <= 0) {
+        // Leave a core for the render thread and one for the network thread
+        num_workers = SDL_max(1, SDL_GetNumLogicalCPUCores() - 2);
+    }
+    workers = (SDL_Thread**) SDL_calloc(num_workers, sizeof(SDL_Thread*));
+    for (int i = 0; i < num_workers; i++) {
+        workers[i] = SDL_CreateThread(decode_worker, "decode_worker", NULL);
+        if (workers[i] == NULL) {
+            SDL_Log("Could not create decode worker: '%s'\n", SDL_GetError());
+            return false;
+        }
+    }
+    return true;
+}
+
+void images_acquire(int xkcd_number, const char* url, int priority) {
+    image_t* image = image_at(xkcd_number);
+    if (image == NULL) {
+        return;
+    }
+    image->refs++;
+    if (image->state != image_state_none) {
+        return;
+    }
+    const store_record_t* record = store_get(xkcd_number);
+    if (record && record->image.size > 0) {
+        // Mirrored by a sync, no need to go to the network
+        queue_decode(xkcd_number, store_string(record->image), record->image.size);
+        return;
+    }
+    image->state = image_state_fetching;
+    image->job = fetch_submit(url, NULL, priority, image_fetched, (void*) (intptr_t) xkcd_number);
+}
+
+void images_release(int xkcd_number) {
+    image_t* image = image_at(xkcd_number);
+    if (image == NULL || image->refs == 0) {
+        return;
+    }
+    image->refs--;
+    if (image->refs > 0) {
+        return;
+    }
+    if (image->state == image_state_fetching) {
+        // Nobody is going to look at it, stop the download
+        fetch_cancel(image->job);
+        image->job = NULL;
+        image->state = image_state_none;
+    }
+    else if (image->state == image_state_ready) {
+        atlas_remove(&image->region);
+        image->state = image_state_none;
+    }
+    else if (image->state == image_state_failed) {
+        // Give it another try the next time the comic shows up
+        image->state = image_state_none;
+    }
+}
+
+void images_update(void) {
+    for (int i = 0; i < IMAGE_UPLOADS_PER_FRAME; i++) {
+        SDL_LockMutex(mutex);
+        decode_job_t* job = queue_pop(&decoded);
+        SDL_UnlockMutex(mutex);
+        if (job == NULL) {
+            return;
+        }
+        image_t* image = image_at(job->xkcd_number);
+        if (image->refs == 0) {
+            image->state = image_state_none;
+        }
+        else if (job->surface && atlas_insert(job->surface, &image->region)) {
+            image->state = image_state_ready;
+        }
+        else {
+            image->state = image_state_failed;
+        }
+        free_decode_job(job);
+    }
+}
+
+bool images_ready(int xkcd_number) {
+    return xkcd_number >= 0 && xkcd_number < images_capacity && images[xkcd_number].state == image_state_ready;
+}
+
+void images_draw(int xkcd_number, SDL_FRect bounds) {
+    if (!images_ready(xkcd_number)) {
+        return;
+    }
+    // Scale to fit the bounds while keeping the aspect ratio
+    const atlas_region_t* region = &images[xkcd_number].region;
+    float image_w = (float) region->rect.w;
+    float image_h = (float) region->rect.h;
+    float scale = SDL_min(bounds.w / image_w, bounds.h / image_h);
+    SDL_FRect destination = {
+        .x = bounds.x + (bounds.w - image_w * scale) * 0.5f,
+        .y = bounds.y + (bounds.h - image_h * scale) * 0.5f,
+        .w = image_w * scale,
+        .h = image_h * scale
+    };
+    atlas_draw(region, destination);
+}
+
+void images_flush(void) {
+    atlas_flush();
+}
+
+void images_shutdown(void) {
+    if (mutex) {
+        SDL_LockMutex(mutex);
+        quit = true;
+        SDL_BroadcastCondition(work_available);
+        SDL_UnlockMutex(mutex);
+    }
+    for (int i = 0; i < num_workers; i++) {
+        if (workers[i]) {
+            SDL_WaitThread(workers[i], NULL);
+        }
+    }
+    SDL_free(workers);
+    workers = NULL;
+    num_workers = 0;
+    decode_queue_t* queues[] = { &to_decode, &decoded };
+    for (size_t i = 0; i < SDL_arraysize(queues); i++) {
+        decode_job_t* job;
+        while ((job = queue_pop(queues[i]))) {
+            free_decode_job(job);
+        }
+    }
+    atlas_shutdown();
+    SDL_free(images);
+    images = NULL;
+    images_capacity = 0;
+    SDL_DestroyCondition(work_available);
+    SDL_DestroyMutex(mutex);
+    work_available = NULL;
+    mutex = NULL;
+}
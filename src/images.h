@@ -0,0 +1,31 @@
+#ifndef IMAGES_H
+#define IMAGES_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+
+// Starts the decode workers (config.decode_threads of them). Images end up as downscaled
+// thumbnails in a texture atlas, so a whole wall draws with a few calls
+bool images_init(SDL_Renderer* renderer);
+
+// Takes a reference on the image of a comic, fetching and decoding it unless that already happened.
+// Everything but images_init and images_shutdown has to be called on the main thread
+void images_acquire(int xkcd_number, const char* url, int priority);
+
+// Drops a reference, the atlas space is reused once no tile shows the image anymore
+void images_release(int xkcd_number);
+
+// Copies decoded thumbnails into the atlas, call once per frame
+void images_update(void);
+
+bool images_ready(int xkcd_number);
+
+// Queues the image drawn centred inside bounds, does nothing until the image is ready
+void images_draw(int xkcd_number, SDL_FRect bounds);
+
+// Draws everything queued by images_draw
+void images_flush(void);
+
+void images_shutdown(void);
+
+#endif
@@ -70,6 +70,7 @@ extern "C" {
 
 struct json_value_s;
 struct json_parse_result_s;
+struct json_stream_s;
 
 enum json_parse_flags_e {
   json_parse_flags_default = 0,
@@ -122,6 +123,10 @@ enum json_parse_flags_e {
   /* allow multi line string values. */
   json_parse_flags_allow_multi_line_strings = 0x2000,
 
+  /* build a hash index of the names next to every object, so that
+     json_object_find finds an element without walking the whole object. */
+  json_parse_flags_build_object_index = 0x4000,
+
   /* allow simplified JSON to be parsed. Simplified JSON is an enabling of a set
      of other parsing options. */
   json_parse_flags_allow_simplified_json =
@@ -161,6 +166,124 @@ json_parse_ex(const void *src, size_t src_size, size_t flags_bitset,
               void *(*alloc_func_ptr)(void *, size_t), void *user_data,
               struct json_parse_result_s *result);
 
+/* Parse a strict JSON (json_parse_flags_default) text file in place, in a
+ * single pass over src. Strings are unescaped and null terminated inside src
+ * and the DOM points at them instead of holding copies, so src is modified and
+ * has to outlive the DOM. If alloc_func_ptr is null the DOM is returned in the
+ * buffer it was grown in and released with free, otherwise it is copied into 1
+ * call to alloc_func_ptr. If an error occurred the result struct (if not NULL)
+ * holds it in the fields json_parse_ex uses, and src is left partially
+ * unescaped. Only the DOM is guaranteed to match json_parse, a malformed input
+ * can get a different error code (e.g. a trailing comma in an object). */
+json_weak struct json_value_s *
+json_parse_in_situ(void *src, size_t src_size,
+                   void *(*alloc_func_ptr)(void *, size_t), void *user_data,
+                   struct json_parse_result_s *result);
+
+/* The events a push parser reports, in document order. */
+enum json_stream_event_e {
+  /* an object or array starts, the events of its contents follow up to the.
+   * matching end event. */
+  json_stream_event_object_begin,
+  json_stream_event_object_end,
+  json_stream_event_array_begin,
+  json_stream_event_array_end,
+
+  /* the name of the next object element, data is the unescaped utf-8 name. */
+  json_stream_event_key,
+
+  /* data is the unescaped utf-8 string. */
+  json_stream_event_string,
+
+  /* data is the number exactly as it appeared in the input. */
+  json_stream_event_number,
+
+  json_stream_event_true,
+  json_stream_event_false,
+  json_stream_event_null
+};
+
+/* Receives the events of a push parser. data is null terminated and only valid
+ * during the call, it is null for events that carry no data. */
+typedef void (*json_stream_callback_t)(void *user_data,
+                                       enum json_stream_event_e event,
+                                       const char *data, size_t data_size);
+
+/* Create a push parser for strict JSON (json_parse_flags_default). Input is
+ * handed to json_stream_feed in chunks of any size as it arrives, strings,
+ * numbers and literals may span chunks. If callback is not null it receives
+ * the events as they are parsed, otherwise the parser builds a DOM as it goes
+ * which json_stream_finish returns. Returns 0 if malloc failed. */
+json_weak struct json_stream_s *
+json_stream_create(json_stream_callback_t callback, void *user_data);
+
+/* Parse the next chunk of input. Returns json_parse_error_none, or the error
+ * (one of json_parse_error_e) that stopped the parser. Once stopped further
+ * input is ignored and the same error is returned. */
+json_weak size_t json_stream_feed(struct json_stream_s *stream,
+                                  const void *src, size_t src_size);
+
+/* Signal the end of the input. In DOM mode returns the root of the JSON
+ * structure, a single allocation like the result of json_parse that is
+ * released with free. Returns 0 in event mode or if an error occurred, the
+ * result struct (if not NULL) then holds the error and its location in the
+ * fields json_parse_ex uses. Only the DOM is guaranteed to match json_parse:
+ * a malformed input can get a different error code or offset, e.g. a trailing
+ * comma in an object or a literal cut short by the end of the input. */
+json_weak struct json_value_s *
+json_stream_finish(struct json_stream_s *stream,
+                   struct json_parse_result_s *result);
+
+/* Like json_stream_finish, but the DOM is allocated with 1 call to
+ * alloc_func_ptr. If alloc_func_ptr is null then malloc is used. */
+json_weak struct json_value_s *
+json_stream_finish_ex(struct json_stream_s *stream,
+                      void *(*alloc_func_ptr)(void *, size_t), void *user_data,
+                      struct json_parse_result_s *result);
+
+/* Start over with a new document, keeping the callback and the memory the
+ * parser has grown so far. */
+json_weak void json_stream_reset(struct json_stream_s *stream);
+
+/* Free the parser, with or without having finished it. */
+json_weak void json_stream_destroy(struct json_stream_s *stream);
+
+/* A value looked up by json_select_fields. */
+struct json_field_s {
+  /* the key path of the value from the root object, with the keys separated
+   * by '.' (e.g. "num" or "a.b"). Set by the caller, keys are compared as
+   * they are written in the input. */
+  const char *path;
+
+  /* the type of the value (one of json_type_e). */
+  size_t type;
+
+  /* the value as it appears in the input, pointing into src: the contents of
+   * a string without its quotes and still escaped (see json_unescape_string),
+   * a number or literal as written, or the whole text of an object or array.
+   * Null if the path was not found. */
+  const char *value;
+  size_t value_size;
+};
+
+/* Look up a few values of a JSON text file without building a DOM. Every
+ * value that is not on the way to one of the fields is skipped by only
+ * looking for its end, and scanning stops once all fields have been found, so
+ * skipped values (and anything after the last field) are not validated.
+ * Returns json_parse_error_none, or the error (one of json_parse_error_e)
+ * that stopped the scan, in which case some fields may not have been found.
+ * Performs no allocations. */
+json_weak size_t json_select_fields(const void *src, size_t src_size,
+                                    struct json_field_s *fields,
+                                    size_t num_fields);
+
+/* Unescape the contents of a JSON string, e.g. a string value returned by
+ * json_select_fields, into dst. Unescaping never makes a string longer, so dst
+ * needs room for src_size + 1 bytes. The result is null terminated and its
+ * size is returned. */
+json_weak size_t json_unescape_string(const char *src, size_t src_size,
+                                      char *dst);
+
 /* Extracts a value and all the data that makes it up into a newly created
  * value. json_extract_value performs 1 call to malloc for the entire encoding.
  */
@@ -215,6 +338,15 @@ json_value_as_object(struct json_value_s *const value);
 json_weak struct json_array_s *
 json_value_as_array(struct json_value_s *const value);
 
+/* Look up the value of the element called name in an object, or the first of
+ * them if the name is used more than once. Takes constant time on average if
+ * the object was parsed with json_parse_flags_build_object_index, otherwise
+ * the elements are compared one by one. Returns null if there is no such
+ * element. */
+json_weak struct json_value_s *
+json_object_find(const struct json_object_s *const object, const char *name,
+                 size_t name_size);
+
 /* Whether the value is true. */
 json_weak int json_value_is_true(const struct json_value_s *const value);
 
@@ -287,6 +419,12 @@ typedef struct json_object_s {
   struct json_object_element_s *start;
   /* the number of elements in the object. */
   size_t length;
+  /* an open addressing hash table of the elements, with
+   * json_object_index_capacity(length) slots, or null if the object was not
+   * parsed with json_parse_flags_build_object_index. Note that the member is
+   * there either way: it makes every object a pointer bigger than in upstream
+   * json.h, so code built against the upstream layout must be rebuilt. */
+  struct json_object_element_s **index;
 
 } json_object_t;
 
@@ -418,6 +556,23 @@ typedef struct json_parse_result_s {
 #define json_strtoumax strtoumax
 #endif
 
+/* the scanning loops look at 32 (AVX2) or 16 (SSE2) bytes at a time when the
+ * compiler targets those instruction sets. define JSON_DISABLE_SIMD to only use
+ * the scalar loops, which are the reference for the vectorized ones. */
+#if !defined(JSON_DISABLE_SIMD) && defined(__AVX2__)
+#define JSON_SIMD_AVX2
+#include <immintrin.h>
+#elif !defined(JSON_DISABLE_SIMD) &&                                           \
+    (defined(__SSE2__) || defined(_M_X64) ||                                   \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define JSON_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+#if (defined(JSON_SIMD_AVX2) || defined(JSON_SIMD_SSE2)) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #if defined(__cplusplus) && (__cplusplus >= 201103L)
 #define json_null nullptr
 #else
@@ -516,6 +671,179 @@ int json_hexadecimal_value(const char *c, const unsigned long size,
   return 1;
 }
 
+#if defined(JSON_SIMD_AVX2) || defined(JSON_SIMD_SSE2)
+/* index of the lowest set bit, mask must not be 0. */
+json_weak unsigned json_lowest_bit(unsigned mask);
+unsigned json_lowest_bit(unsigned mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (unsigned)index;
+#else
+  return (unsigned)__builtin_ctz(mask);
+#endif
+}
+#endif
+
+/* Returns the offset of the first quote_to_use, '\' or control character
+ * (below 0x20) at or after offset, or size if there is none. */
+json_weak size_t json_find_string_special_scalar(const char *src,
+                                                 size_t offset, size_t size,
+                                                 char quote_to_use);
+size_t json_find_string_special_scalar(const char *src, size_t offset,
+                                       size_t size, char quote_to_use) {
+  while (offset < size && quote_to_use != src[offset] &&
+         '\\' != src[offset] && (unsigned char)src[offset] >= 0x20) {
+    offset++;
+  }
+
+  return offset;
+}
+
+json_weak size_t json_find_string_special(const char *src, size_t offset,
+                                          size_t size, char quote_to_use);
+size_t json_find_string_special(const char *src, size_t offset, size_t size,
+                                char quote_to_use) {
+#if defined(JSON_SIMD_AVX2)
+  const __m256i quote = _mm256_set1_epi8(quote_to_use);
+  const __m256i reverse_solidus = _mm256_set1_epi8('\\');
+  const __m256i control = _mm256_set1_epi8(0x1f);
+
+  while (offset + 32 <= size) {
+    const __m256i chunk =
+        _mm256_loadu_si256((const __m256i *)(const void *)(src + offset));
+    /* max(c, 0x1f) == 0x1f is an unsigned c <= 0x1f. */
+    const __m256i special = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote),
+                        _mm256_cmpeq_epi8(chunk, reverse_solidus)),
+        _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, control), control));
+    const unsigned mask = (unsigned)_mm256_movemask_epi8(special);
+
+    if (0 != mask) {
+      return offset + json_lowest_bit(mask);
+    }
+
+    offset += 32;
+  }
+#elif defined(JSON_SIMD_SSE2)
+  const __m128i quote = _mm_set1_epi8(quote_to_use);
+  const __m128i reverse_solidus = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1f);
+
+  while (offset + 16 <= size) {
+    const __m128i chunk =
+        _mm_loadu_si128((const __m128i *)(const void *)(src + offset));
+    /* max(c, 0x1f) == 0x1f is an unsigned c <= 0x1f. */
+    const __m128i special =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                  _mm_cmpeq_epi8(chunk, reverse_solidus)),
+                     _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+    const unsigned mask = (unsigned)_mm_movemask_epi8(special);
+
+    if (0 != mask) {
+      return offset + json_lowest_bit(mask);
+    }
+
+    offset += 16;
+  }
+#endif
+
+  /* whatever is left is shorter than a vector. */
+  return json_find_string_special_scalar(src, offset, size, quote_to_use);
+}
+
+/* Returns the offset of the first character at or after offset that is not
+ * whitespace, or size if there is none, counting the newlines skipped. */
+json_weak size_t json_find_non_whitespace_scalar(const char *src,
+                                                 size_t offset, size_t size,
+                                                 size_t *line_no,
+                                                 size_t *line_offset);
+size_t json_find_non_whitespace_scalar(const char *src, size_t offset,
+                                       size_t size, size_t *line_no,
+                                       size_t *line_offset) {
+  for (; offset < size; offset++) {
+    switch (src[offset]) {
+    default:
+      return offset;
+    case ' ':
+    case '\r':
+    case '\t':
+      break;
+    case '\n':
+      (*line_no)++;
+      *line_offset = offset;
+      break;
+    }
+  }
+
+  return offset;
+}
+
+json_weak size_t json_find_non_whitespace(const char *src, size_t offset,
+                                          size_t size, size_t *line_no,
+                                          size_t *line_offset);
+size_t json_find_non_whitespace(const char *src, size_t offset, size_t size,
+                                size_t *line_no, size_t *line_offset) {
+#if defined(JSON_SIMD_AVX2)
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i carriage_return = _mm256_set1_epi8('\r');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i newline = _mm256_set1_epi8('\n');
+
+  while (offset + 32 <= size) {
+    const __m256i chunk =
+        _mm256_loadu_si256((const __m256i *)(const void *)(src + offset));
+    const __m256i newlines = _mm256_cmpeq_epi8(chunk, newline);
+    const __m256i whitespace = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space),
+                        _mm256_cmpeq_epi8(chunk, carriage_return)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, tab), newlines));
+    const unsigned other = ~(unsigned)_mm256_movemask_epi8(whitespace);
+    unsigned newline_mask = (unsigned)_mm256_movemask_epi8(newlines);
+    const unsigned length = 0 != other ? json_lowest_bit(other) : 32;
+#elif defined(JSON_SIMD_SSE2)
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i carriage_return = _mm_set1_epi8('\r');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i newline = _mm_set1_epi8('\n');
+
+  while (offset + 16 <= size) {
+    const __m128i chunk =
+        _mm_loadu_si128((const __m128i *)(const void *)(src + offset));
+    const __m128i newlines = _mm_cmpeq_epi8(chunk, newline);
+    const __m128i whitespace =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                                  _mm_cmpeq_epi8(chunk, carriage_return)),
+                     _mm_or_si128(_mm_cmpeq_epi8(chunk, tab), newlines));
+    const unsigned other =
+        ~(unsigned)_mm_movemask_epi8(whitespace) & 0xffffu;
+    unsigned newline_mask = (unsigned)_mm_movemask_epi8(newlines);
+    const unsigned length = 0 != other ? json_lowest_bit(other) : 16;
+#endif
+#if defined(JSON_SIMD_AVX2) || defined(JSON_SIMD_SSE2)
+    /* only the newlines before the first other character were skipped. */
+    if (length < 32) {
+      newline_mask &= (1u << length) - 1;
+    }
+
+    while (0 != newline_mask) {
+      (*line_no)++;
+      *line_offset = offset + json_lowest_bit(newline_mask);
+      newline_mask &= newline_mask - 1;
+    }
+
+    offset += length;
+    if (0 != other) {
+      return offset;
+    }
+  }
+#endif
+
+  /* whatever is left is shorter than a vector. */
+  return json_find_non_whitespace_scalar(src, offset, size, line_no,
+                                         line_offset);
+}
+
 json_weak int json_skip_whitespace(struct json_parse_state_s *state);
 int json_skip_whitespace(struct json_parse_state_s *state) {
   size_t offset = state->offset;
@@ -538,27 +866,9 @@ int json_skip_whitespace(struct json_parse_state_s *state) {
     break;
   }
 
-  do {
-    switch (src[offset]) {
-    default:
-      /* Update offset. */
-      state->offset = offset;
-      return 1;
-    case ' ':
-    case '\r':
-    case '\t':
-      break;
-    case '\n':
-      state->line_no++;
-      state->line_offset = offset;
-      break;
-    }
-
-    offset++;
-  } while (offset < size);
-
   /* Update offset. */
-  state->offset = offset;
+  state->offset = json_find_non_whitespace(src, offset, size, &state->line_no,
+                                           &state->line_offset);
   return 1;
 }
 
@@ -717,6 +1027,17 @@ int json_get_string_size(struct json_parse_state_s *state, size_t is_key) {
   offset++;
 
   while ((offset < size) && (quote_to_use != src[offset])) {
+    /* plain characters need no further checks, skip a run of them at once. */
+    const size_t special =
+        json_find_string_special(src, offset, size, quote_to_use);
+
+    data_size += special - offset;
+    offset = special;
+
+    if ((offset == size) || (quote_to_use == src[offset])) {
+      break;
+    }
+
     /* add space for the character. */
     data_size++;
 
@@ -918,6 +1239,63 @@ int json_get_key_size(struct json_parse_state_s *state) {
   }
 }
 
+/* The number of slots in the index of an object with length elements, a power
+ * of two that keeps the table at most half full. */
+json_weak size_t json_object_index_capacity(size_t length);
+size_t json_object_index_capacity(size_t length) {
+  size_t capacity = 2;
+
+  while (capacity < length * 2) {
+    capacity *= 2;
+  }
+
+  return capacity;
+}
+
+/* FNV-1a, names are short and this is cheap to compute while parsing. */
+json_weak size_t json_hash_name(const char *name, size_t name_size);
+size_t json_hash_name(const char *name, size_t name_size) {
+  size_t hash = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < name_size; i++) {
+    hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+  }
+
+  return hash;
+}
+
+/* Fill index (json_object_index_capacity(object->length) slots) with the
+ * elements of object. Duplicate names keep the first element. */
+json_weak void json_object_index_build(struct json_object_s *object,
+                                       struct json_object_element_s **index);
+void json_object_index_build(struct json_object_s *object,
+                             struct json_object_element_s **index) {
+  const size_t mask = json_object_index_capacity(object->length) - 1;
+  struct json_object_element_s *element;
+
+  memset(index, 0, sizeof(struct json_object_element_s *) * (mask + 1));
+
+  for (element = object->start; json_null != element;
+       element = element->next) {
+    const struct json_string_s *name = element->name;
+    size_t slot = json_hash_name(name->string, name->string_size) & mask;
+
+    while (json_null != index[slot] &&
+           !(index[slot]->name->string_size == name->string_size &&
+             0 == memcmp(index[slot]->name->string, name->string,
+                         name->string_size))) {
+      slot = (slot + 1) & mask;
+    }
+
+    if (json_null == index[slot]) {
+      index[slot] = element;
+    }
+  }
+
+  object->index = index;
+}
+
 json_weak int json_get_object_size(struct json_parse_state_s *state,
                                    int is_global_object);
 int json_get_object_size(struct json_parse_state_s *state,
@@ -1053,6 +1431,11 @@ int json_get_object_size(struct json_parse_state_s *state,
 
   state->dom_size += sizeof(struct json_object_element_s) * elements;
 
+  if ((json_parse_flags_build_object_index & flags_bitset) && 0 != elements) {
+    state->dom_size += sizeof(struct json_object_element_s *) *
+                       json_object_index_capacity(elements);
+  }
+
   return 0;
 }
 
@@ -1480,6 +1863,18 @@ void json_parse_string(struct json_parse_state_s *state,
   offset++;
 
   while (quote_to_use != src[offset]) {
+    /* copy a run of plain characters at once. */
+    const size_t special =
+        json_find_string_special(src, offset, state->size, quote_to_use);
+
+    memcpy(data + bytes_written, src + offset, special - offset);
+    bytes_written += special - offset;
+    offset = special;
+
+    if (quote_to_use == src[offset]) {
+      break;
+    }
+
     if ('\\' == src[offset]) {
       /* skip the reverse solidus. */
       offset++;
@@ -1770,6 +2165,14 @@ void json_parse_object(struct json_parse_state_s *state, int is_global_object,
   }
 
   object->length = elements;
+  object->index = json_null;
+
+  if ((json_parse_flags_build_object_index & flags_bitset) && 0 != elements) {
+    json_object_index_build(object,
+                            (struct json_object_element_s **)state->dom);
+    state->dom += sizeof(struct json_object_element_s *) *
+                  json_object_index_capacity(elements);
+  }
 }
 
 json_weak void json_parse_array(struct json_parse_state_s *state,
@@ -2175,135 +2578,2054 @@ struct json_value_s *json_parse(const void *src, size_t src_size) {
                        json_null, json_null);
 }
 
-struct json_extract_result_s {
-  size_t dom_size;
-  size_t data_size;
+enum json_stream_state_e {
+  /* expecting a value. */
+  json_stream_state_value,
+
+  /* just after '[', expecting a value or ']'. */
+  json_stream_state_value_or_close,
+
+  /* just after '{', expecting a key or '}'. */
+  json_stream_state_key_or_close,
+
+  /* after ',' in an object, expecting a key. */
+  json_stream_state_key,
+
+  json_stream_state_colon,
+
+  /* after a value inside an object or array. */
+  json_stream_state_comma_or_close,
+
+  /* the value is complete, only whitespace may follow. */
+  json_stream_state_done,
+
+  /* the states above skip whitespace, the ones below are inside a token. */
+  json_stream_state_string,
+
+  /* after a '\' inside a string. */
+  json_stream_state_escape,
+
+  /* reading the hexadecimal digits of a \u escape. */
+  json_stream_state_unicode,
+
+  json_stream_state_number,
+
+  /* reading the rest of true, false or null. */
+  json_stream_state_literal
 };
 
-struct json_value_s *json_extract_value(const struct json_value_s *value) {
-  return json_extract_value_ex(value, json_null, json_null);
-}
+/* A DOM that is built without knowing its size up front. Every pointer in it
+ * holds an offset into data until json_dom_relocate turns it into a real
+ * pointer. */
+struct json_dom_buffer_s {
+  char *data;
+  size_t size;
+  size_t capacity;
+};
 
-json_weak struct json_extract_result_s
-json_extract_get_number_size(const struct json_number_s *const number);
-json_weak struct json_extract_result_s
-json_extract_get_string_size(const struct json_string_s *const string);
-json_weak struct json_extract_result_s
-json_extract_get_object_size(const struct json_object_s *const object);
-json_weak struct json_extract_result_s
-json_extract_get_array_size(const struct json_array_s *const array);
-json_weak struct json_extract_result_s
-json_extract_get_value_size(const struct json_value_s *const value);
+struct json_stream_frame_s {
+  /* '{' or '['. */
+  char bracket;
 
-struct json_extract_result_s
-json_extract_get_number_size(const struct json_number_s *const number) {
-  struct json_extract_result_s result;
-  result.dom_size = sizeof(struct json_number_s);
-  result.data_size = number->number_size;
-  return result;
-}
+  /* dom offset of the json_object_s or json_array_s. */
+  size_t payload;
 
-struct json_extract_result_s
-json_extract_get_string_size(const struct json_string_s *const string) {
-  struct json_extract_result_s result;
-  result.dom_size = sizeof(struct json_string_s);
-  result.data_size = string->string_size + 1;
-  return result;
-}
+  /* dom offset of the last element, 0 while there is none. */
+  size_t last;
+};
 
-struct json_extract_result_s
-json_extract_get_object_size(const struct json_object_s *const object) {
-  struct json_extract_result_s result;
-  size_t i;
-  const struct json_object_element_s *element = object->start;
+struct json_stream_s {
+  json_stream_callback_t callback;
+  void *user_data;
+  int state;
 
-  result.dom_size = sizeof(struct json_object_s) +
-                    (sizeof(struct json_object_element_s) * object->length);
-  result.data_size = 0;
+  /* the first error, and where in the input it happened. */
+  size_t error;
+  size_t error_offset;
+  size_t error_line_no;
+  size_t error_row_no;
 
-  for (i = 0; i < object->length; i++) {
-    const struct json_extract_result_s string_result =
-        json_extract_get_string_size(element->name);
-    const struct json_extract_result_s value_result =
-        json_extract_get_value_size(element->value);
+  /* offset of the next chunk in the whole input, and the line it is on. */
+  size_t offset;
+  size_t line_no;
+  size_t line_offset;
+
+  /* the open objects and arrays, innermost last. */
+  struct json_stream_frame_s *stack;
+  size_t depth;
+  size_t stack_capacity;
+
+  /* the unescaped string or the number being read, it can span chunks. */
+  char *token;
+  size_t token_size;
+  size_t token_capacity;
+  int string_is_key;
+  unsigned long codepoint;
+  int codepoint_digits;
+  unsigned long high_surrogate;
+  const char *literal;
+  size_t literal_matched;
+  enum json_stream_event_e literal_event;
 
-    result.dom_size += string_result.dom_size;
-    result.data_size += string_result.data_size;
+  /* the dom being built (only without a callback). */
+  struct json_dom_buffer_s dom;
 
-    result.dom_size += value_result.dom_size;
-    result.data_size += value_result.data_size;
+  /* dom offset of the json_string_s of the key waiting for its value. */
+  size_t key;
+};
 
-    element = element->next;
+json_weak void *json_grow(void *buffer, size_t *capacity,
+                                 size_t needed, size_t element_size);
+void *json_grow(void *buffer, size_t *capacity, size_t needed,
+                       size_t element_size) {
+  size_t new_capacity = *capacity ? *capacity : 64;
+  void *new_buffer;
+
+  if (needed <= *capacity) {
+    return buffer;
   }
 
-  return result;
+  while (new_capacity < needed) {
+    new_capacity *= 2;
+  }
+
+  new_buffer = realloc(buffer, new_capacity * element_size);
+  if (json_null != new_buffer) {
+    *capacity = new_capacity;
+  }
+
+  return new_buffer;
 }
 
-struct json_extract_result_s
-json_extract_get_array_size(const struct json_array_s *const array) {
-  struct json_extract_result_s result;
-  size_t i;
-  const struct json_array_element_s *element = array->start;
+json_weak void json_stream_fail(struct json_stream_s *stream, size_t error,
+                                size_t offset);
+void json_stream_fail(struct json_stream_s *stream, size_t error,
+                      size_t offset) {
+  if (json_parse_error_none != stream->error) {
+    return;
+  }
 
-  result.dom_size = sizeof(struct json_array_s) +
-                    (sizeof(struct json_array_element_s) * array->length);
-  result.data_size = 0;
+  stream->error = error;
 
-  for (i = 0; i < array->length; i++) {
-    const struct json_extract_result_s value_result =
-        json_extract_get_value_size(element->value);
+  if (json_parse_error_allocator_failed == error) {
+    /* like json_parse_ex, allocation failures have no location. */
+    return;
+  }
 
-    result.dom_size += value_result.dom_size;
-    result.data_size += value_result.data_size;
+  stream->error_offset = offset;
+  stream->error_line_no = stream->line_no;
+  stream->error_row_no = offset - stream->line_offset;
+}
 
-    element = element->next;
+json_weak int json_stream_append(struct json_stream_s *stream,
+                                 const char *data, size_t size);
+int json_stream_append(struct json_stream_s *stream, const char *data,
+                       size_t size) {
+  /* always keep room for the null terminator. */
+  char *token = (char *)json_grow(stream->token, &stream->token_capacity,
+                                         stream->token_size + size + 1, 1);
+
+  if (json_null == token) {
+    json_stream_fail(stream, json_parse_error_allocator_failed, 0);
+    return 0;
   }
 
-  return result;
+  stream->token = token;
+  memcpy(token + stream->token_size, data, size);
+  stream->token_size += size;
+  token[stream->token_size] = '\0';
+  return 1;
 }
 
-struct json_extract_result_s
-json_extract_get_value_size(const struct json_value_s *const value) {
-  struct json_extract_result_s result = {0, 0};
+/* Writes codepoint as 1 to 4 bytes of utf-8 and returns how many. */
+json_weak size_t json_encode_utf8(unsigned long codepoint, char *data);
+size_t json_encode_utf8(unsigned long codepoint, char *data) {
+  if (codepoint <= 0x7fu) {
+    data[0] = (char)codepoint; /* 0xxxxxxx. */
+    return 1;
+  }
 
-  switch (value->type) {
-  default:
-    break;
-  case json_type_object:
-    result = json_extract_get_object_size(
-        (const struct json_object_s *)value->payload);
-    break;
-  case json_type_array:
-    result = json_extract_get_array_size(
-        (const struct json_array_s *)value->payload);
-    break;
-  case json_type_number:
-    result = json_extract_get_number_size(
-        (const struct json_number_s *)value->payload);
-    break;
-  case json_type_string:
-    result = json_extract_get_string_size(
-        (const struct json_string_s *)value->payload);
-    break;
+  if (codepoint <= 0x7ffu) {
+    data[0] = (char)(0xc0u | (codepoint >> 6));   /* 110xxxxx. */
+    data[1] = (char)(0x80u | (codepoint & 0x3fu)); /* 10xxxxxx. */
+    return 2;
   }
 
-  result.dom_size += sizeof(struct json_value_s);
+  if (codepoint <= 0xffffu) {
+    data[0] = (char)(0xe0u | (codepoint >> 12));          /* 1110xxxx. */
+    data[1] = (char)(0x80u | ((codepoint >> 6) & 0x3fu)); /* 10xxxxxx. */
+    data[2] = (char)(0x80u | (codepoint & 0x3fu));        /* 10xxxxxx. */
+    return 3;
+  }
 
-  return result;
+  data[0] = (char)(0xf0u | (codepoint >> 18));           /* 11110xxx. */
+  data[1] = (char)(0x80u | ((codepoint >> 12) & 0x3fu)); /* 10xxxxxx. */
+  data[2] = (char)(0x80u | ((codepoint >> 6) & 0x3fu));  /* 10xxxxxx. */
+  data[3] = (char)(0x80u | (codepoint & 0x3fu));         /* 10xxxxxx. */
+  return 4;
 }
 
-struct json_extract_state_s {
-  char *dom;
-  char *data;
-};
+json_weak int json_stream_append_codepoint(struct json_stream_s *stream,
+                                           unsigned long codepoint);
+int json_stream_append_codepoint(struct json_stream_s *stream,
+                                 unsigned long codepoint) {
+  char utf8[4];
+  return json_stream_append(stream, utf8, json_encode_utf8(codepoint, utf8));
+}
 
-json_weak void json_extract_copy_value(struct json_extract_state_s *const state,
-                                       const struct json_value_s *const value);
-void json_extract_copy_value(struct json_extract_state_s *const state,
-                             const struct json_value_s *const value) {
-  struct json_string_s *string;
-  struct json_number_s *number;
-  struct json_object_s *object;
+json_weak int json_is_strict_number(const char *number, size_t size);
+int json_is_strict_number(const char *number, size_t size) {
+  size_t i = 0;
+
+  if (i < size && '-' == number[i]) {
+    i++;
+  }
+
+  /* no leading zeros. */
+  if (i < size && '0' == number[i]) {
+    i++;
+  } else if (i < size && '1' <= number[i] && number[i] <= '9') {
+    while (i < size && '0' <= number[i] && number[i] <= '9') {
+      i++;
+    }
+  } else {
+    return 0;
+  }
+
+  if (i < size && '.' == number[i]) {
+    i++;
+    if (!(i < size && '0' <= number[i] && number[i] <= '9')) {
+      return 0;
+    }
+    while (i < size && '0' <= number[i] && number[i] <= '9') {
+      i++;
+    }
+  }
+
+  if (i < size && ('e' == number[i] || 'E' == number[i])) {
+    i++;
+    if (i < size && ('+' == number[i] || '-' == number[i])) {
+      i++;
+    }
+    if (!(i < size && '0' <= number[i] && number[i] <= '9')) {
+      return 0;
+    }
+    while (i < size && '0' <= number[i] && number[i] <= '9') {
+      i++;
+    }
+  }
+
+  return i == size;
+}
+
+json_weak int json_dom_alloc(struct json_dom_buffer_s *dom, size_t size,
+                             size_t *offset);
+int json_dom_alloc(struct json_dom_buffer_s *dom, size_t size,
+                   size_t *offset) {
+  const size_t align =
+      sizeof(void *) > sizeof(size_t) ? sizeof(void *) : sizeof(size_t);
+  const size_t start = (dom->size + align - 1) & ~(align - 1);
+  char *data = (char *)json_grow(dom->data, &dom->capacity, start + size, 1);
+
+  if (json_null == data) {
+    return 0;
+  }
+
+  dom->data = data;
+  memset(data + dom->size, 0, start + size - dom->size);
+  dom->size = start + size;
+  *offset = start;
+  return 1;
+}
+
+/* Appends a json_string_s or json_number_s (they share their layout) together
+ * with a copy of its characters. */
+json_weak int json_dom_string(struct json_dom_buffer_s *dom, const char *data,
+                              size_t data_size, size_t *offset);
+int json_dom_string(struct json_dom_buffer_s *dom, const char *data,
+                    size_t data_size, size_t *offset) {
+  struct json_string_s *string;
+  size_t chars;
+
+  if (!json_dom_alloc(dom, sizeof(struct json_string_s), offset) ||
+      !json_dom_alloc(dom, data_size + 1, &chars)) {
+    return 0;
+  }
+
+  memcpy(dom->data + chars, data, data_size);
+  dom->data[chars + data_size] = '\0';
+  string = (struct json_string_s *)(dom->data + *offset);
+  string->string = (const char *)chars;
+  string->string_size = data_size;
+  return 1;
+}
+
+/* The callback used in DOM mode. */
+json_weak int json_stream_build(struct json_stream_s *stream,
+                                enum json_stream_event_e event,
+                                const char *data, size_t data_size);
+int json_stream_build(struct json_stream_s *stream,
+                      enum json_stream_event_e event, const char *data,
+                      size_t data_size) {
+  size_t parent_depth = stream->depth;
+  size_t value;
+  size_t payload = 0;
+  size_t type;
+  struct json_value_s *value_ptr;
+
+  switch (event) {
+  case json_stream_event_object_end:
+  case json_stream_event_array_end:
+    /* the elements were linked in as they arrived. */
+    return 1;
+  case json_stream_event_key:
+    return json_dom_string(&stream->dom, data, data_size, &stream->key);
+  case json_stream_event_object_begin:
+  case json_stream_event_array_begin:
+    /* the frame of the new container has been pushed already. */
+    parent_depth--;
+    break;
+  default:
+    break;
+  }
+
+  /* the first allocation is the root value, at offset 0. */
+  if (!json_dom_alloc(&stream->dom, sizeof(struct json_value_s), &value)) {
+    return 0;
+  }
+
+  if (parent_depth > 0) {
+    struct json_stream_frame_s *parent = &stream->stack[parent_depth - 1];
+    size_t element;
+
+    if ('[' == parent->bracket) {
+      struct json_array_element_s *array_element;
+      struct json_array_s *array;
+
+      if (!json_dom_alloc(&stream->dom, sizeof(struct json_array_element_s),
+                                 &element)) {
+        return 0;
+      }
+
+      array_element =
+          (struct json_array_element_s *)(stream->dom.data + element);
+      array_element->value = (struct json_value_s *)value;
+      array = (struct json_array_s *)(stream->dom.data + parent->payload);
+
+      if (parent->last) {
+        ((struct json_array_element_s *)(stream->dom.data + parent->last))
+            ->next = (struct json_array_element_s *)element;
+      } else {
+        array->start = (struct json_array_element_s *)element;
+      }
+
+      array->length++;
+    } else {
+      struct json_object_element_s *object_element;
+      struct json_object_s *object;
+
+      if (!json_dom_alloc(&stream->dom, sizeof(struct json_object_element_s),
+                                 &element)) {
+        return 0;
+      }
+
+      object_element =
+          (struct json_object_element_s *)(stream->dom.data + element);
+      object_element->name = (struct json_string_s *)stream->key;
+      object_element->value = (struct json_value_s *)value;
+      object = (struct json_object_s *)(stream->dom.data + parent->payload);
+
+      if (parent->last) {
+        ((struct json_object_element_s *)(stream->dom.data + parent->last))
+            ->next = (struct json_object_element_s *)element;
+      } else {
+        object->start = (struct json_object_element_s *)element;
+      }
+
+      object->length++;
+    }
+
+    parent->last = element;
+  }
+
+  switch (event) {
+  default:
+    return 0; /* we cannot ever reach here. */
+  case json_stream_event_string:
+    type = json_type_string;
+    if (!json_dom_string(&stream->dom, data, data_size, &payload)) {
+      return 0;
+    }
+    break;
+  case json_stream_event_number:
+    type = json_type_number;
+    if (!json_dom_string(&stream->dom, data, data_size, &payload)) {
+      return 0;
+    }
+    break;
+  case json_stream_event_object_begin:
+    type = json_type_object;
+    if (!json_dom_alloc(&stream->dom, sizeof(struct json_object_s),
+                               &payload)) {
+      return 0;
+    }
+    stream->stack[stream->depth - 1].payload = payload;
+    break;
+  case json_stream_event_array_begin:
+    type = json_type_array;
+    if (!json_dom_alloc(&stream->dom, sizeof(struct json_array_s),
+                               &payload)) {
+      return 0;
+    }
+    stream->stack[stream->depth - 1].payload = payload;
+    break;
+  case json_stream_event_true:
+    type = json_type_true;
+    break;
+  case json_stream_event_false:
+    type = json_type_false;
+    break;
+  case json_stream_event_null:
+    type = json_type_null;
+    break;
+  }
+
+  value_ptr = (struct json_value_s *)(stream->dom.data + value);
+  value_ptr->type = type;
+  value_ptr->payload = (void *)payload;
+  return 1;
+}
+
+/* Turns the offsets stored in a DOM built by json_stream_build or
+ * json_parse_in_situ into pointers relative to base. Unless strings_in_dom is
+ * set the characters of strings and names already point into the source. */
+json_weak void json_dom_relocate(char *base, struct json_value_s *value,
+                                 int strings_in_dom);
+void json_dom_relocate(char *base, struct json_value_s *value,
+                       int strings_in_dom) {
+  if (json_null != value->payload) {
+    value->payload = base + (size_t)value->payload;
+  }
+
+  switch (value->type) {
+  default:
+    break;
+  case json_type_string:
+    if (!strings_in_dom) {
+      break;
+    }
+    /* Falls through. */
+  case json_type_number: {
+    struct json_string_s *string = (struct json_string_s *)value->payload;
+    string->string = base + (size_t)string->string;
+  } break;
+  case json_type_object: {
+    struct json_object_s *object = (struct json_object_s *)value->payload;
+    struct json_object_element_s *element;
+
+    if (json_null != object->start) {
+      object->start =
+          (struct json_object_element_s *)(base + (size_t)object->start);
+    }
+
+    for (element = object->start; json_null != element;
+         element = element->next) {
+      if (json_null != element->next) {
+        element->next =
+            (struct json_object_element_s *)(base + (size_t)element->next);
+      }
+      element->name = (struct json_string_s *)(base + (size_t)element->name);
+      if (strings_in_dom) {
+        element->name->string = base + (size_t)element->name->string;
+      }
+      element->value = (struct json_value_s *)(base + (size_t)element->value);
+      json_dom_relocate(base, element->value, strings_in_dom);
+    }
+  } break;
+  case json_type_array: {
+    struct json_array_s *array = (struct json_array_s *)value->payload;
+    struct json_array_element_s *element;
+
+    if (json_null != array->start) {
+      array->start =
+          (struct json_array_element_s *)(base + (size_t)array->start);
+    }
+
+    for (element = array->start; json_null != element;
+         element = element->next) {
+      if (json_null != element->next) {
+        element->next =
+            (struct json_array_element_s *)(base + (size_t)element->next);
+      }
+      element->value = (struct json_value_s *)(base + (size_t)element->value);
+      json_dom_relocate(base, element->value, strings_in_dom);
+    }
+  } break;
+  }
+}
+
+json_weak void json_stream_emit(struct json_stream_s *stream,
+                                enum json_stream_event_e event,
+                                const char *data, size_t data_size);
+void json_stream_emit(struct json_stream_s *stream,
+                      enum json_stream_event_e event, const char *data,
+                      size_t data_size) {
+  if (json_null != stream->callback) {
+    stream->callback(stream->user_data, event, data, data_size);
+  } else if (!json_stream_build(stream, event, data, data_size)) {
+    json_stream_fail(stream, json_parse_error_allocator_failed, 0);
+  }
+}
+
+json_weak void json_stream_end_value(struct json_stream_s *stream);
+void json_stream_end_value(struct json_stream_s *stream) {
+  stream->state = stream->depth > 0 ? json_stream_state_comma_or_close
+                                    : json_stream_state_done;
+}
+
+json_weak void json_stream_begin_string(struct json_stream_s *stream,
+                                        int is_key);
+void json_stream_begin_string(struct json_stream_s *stream, int is_key) {
+  stream->token_size = 0;
+  stream->string_is_key = is_key;
+  stream->high_surrogate = 0;
+  stream->state = json_stream_state_string;
+}
+
+json_weak void json_stream_end_string(struct json_stream_s *stream);
+void json_stream_end_string(struct json_stream_s *stream) {
+  /* make sure even an empty string has its null terminator. */
+  if (!json_stream_append(stream, "", 0)) {
+    return;
+  }
+
+  if (stream->string_is_key) {
+    json_stream_emit(stream, json_stream_event_key, stream->token,
+                     stream->token_size);
+    stream->state = json_stream_state_colon;
+  } else {
+    json_stream_emit(stream, json_stream_event_string, stream->token,
+                     stream->token_size);
+    json_stream_end_value(stream);
+  }
+}
+
+json_weak void json_stream_end_number(struct json_stream_s *stream,
+                                      size_t offset);
+void json_stream_end_number(struct json_stream_s *stream, size_t offset) {
+  if (!json_is_strict_number(stream->token, stream->token_size)) {
+    json_stream_fail(stream, json_parse_error_invalid_number_format, offset);
+    return;
+  }
+
+  json_stream_emit(stream, json_stream_event_number, stream->token,
+                   stream->token_size);
+  json_stream_end_value(stream);
+}
+
+json_weak void json_stream_open(struct json_stream_s *stream, char bracket);
+void json_stream_open(struct json_stream_s *stream, char bracket) {
+  struct json_stream_frame_s *stack = (struct json_stream_frame_s *)
+      json_grow(stream->stack, &stream->stack_capacity,
+                       stream->depth + 1, sizeof(struct json_stream_frame_s));
+
+  if (json_null == stack) {
+    json_stream_fail(stream, json_parse_error_allocator_failed, 0);
+    return;
+  }
+
+  stream->stack = stack;
+  stack[stream->depth].bracket = bracket;
+  stack[stream->depth].payload = 0;
+  stack[stream->depth].last = 0;
+  stream->depth++;
+
+  if ('{' == bracket) {
+    json_stream_emit(stream, json_stream_event_object_begin, json_null, 0);
+    stream->state = json_stream_state_key_or_close;
+  } else {
+    json_stream_emit(stream, json_stream_event_array_begin, json_null, 0);
+    stream->state = json_stream_state_value_or_close;
+  }
+}
+
+json_weak void json_stream_close(struct json_stream_s *stream, char bracket,
+                                 size_t offset);
+void json_stream_close(struct json_stream_s *stream, char bracket,
+                       size_t offset) {
+  const char opening = '}' == bracket ? '{' : '[';
+
+  if (0 == stream->depth || opening != stream->stack[stream->depth - 1].bracket) {
+    json_stream_fail(stream, json_parse_error_expected_comma_or_closing_bracket,
+                     offset);
+    return;
+  }
+
+  stream->depth--;
+  json_stream_emit(stream,
+                   '{' == opening ? json_stream_event_object_end
+                                  : json_stream_event_array_end,
+                   json_null, 0);
+  json_stream_end_value(stream);
+}
+
+json_weak void json_stream_begin_literal(struct json_stream_s *stream,
+                                         const char *literal,
+                                         enum json_stream_event_e event);
+void json_stream_begin_literal(struct json_stream_s *stream,
+                               const char *literal,
+                               enum json_stream_event_e event) {
+  stream->literal = literal;
+  stream->literal_matched = 1;
+  stream->literal_event = event;
+  stream->state = json_stream_state_literal;
+}
+
+json_weak void json_stream_begin_value(struct json_stream_s *stream, char c,
+                                       size_t offset);
+void json_stream_begin_value(struct json_stream_s *stream, char c,
+                             size_t offset) {
+  switch (c) {
+  case '{':
+  case '[':
+    json_stream_open(stream, c);
+    break;
+  case '"':
+    json_stream_begin_string(stream, 0);
+    break;
+  case 't':
+    json_stream_begin_literal(stream, "true", json_stream_event_true);
+    break;
+  case 'f':
+    json_stream_begin_literal(stream, "false", json_stream_event_false);
+    break;
+  case 'n':
+    json_stream_begin_literal(stream, "null", json_stream_event_null);
+    break;
+  case '-':
+  case '0':
+  case '1':
+  case '2':
+  case '3':
+  case '4':
+  case '5':
+  case '6':
+  case '7':
+  case '8':
+  case '9':
+    stream->token_size = 0;
+    if (json_stream_append(stream, &c, 1)) {
+      stream->state = json_stream_state_number;
+    }
+    break;
+  default:
+    json_stream_fail(stream, json_parse_error_invalid_value, offset);
+    break;
+  }
+}
+
+json_weak void json_stream_escape(struct json_stream_s *stream, char c,
+                                  size_t offset);
+void json_stream_escape(struct json_stream_s *stream, char c, size_t offset) {
+  char unescaped;
+
+  if (stream->high_surrogate && 'u' != c) {
+    /* a high surrogate has to be followed by its low half. */
+    json_stream_fail(stream, json_parse_error_invalid_string_escape_sequence,
+                     offset);
+    return;
+  }
+
+  switch (c) {
+  case 'u':
+    stream->codepoint = 0;
+    stream->codepoint_digits = 0;
+    stream->state = json_stream_state_unicode;
+    return;
+  case '"':
+  case '\\':
+  case '/':
+    unescaped = c;
+    break;
+  case 'b':
+    unescaped = '\b';
+    break;
+  case 'f':
+    unescaped = '\f';
+    break;
+  case 'n':
+    unescaped = '\n';
+    break;
+  case 'r':
+    unescaped = '\r';
+    break;
+  case 't':
+    unescaped = '\t';
+    break;
+  default:
+    json_stream_fail(stream, json_parse_error_invalid_string_escape_sequence,
+                     offset);
+    return;
+  }
+
+  if (json_stream_append(stream, &unescaped, 1)) {
+    stream->state = json_stream_state_string;
+  }
+}
+
+json_weak void json_stream_unicode(struct json_stream_s *stream, char c,
+                                   size_t offset);
+void json_stream_unicode(struct json_stream_s *stream, char c, size_t offset) {
+  const int digit = json_hexadecimal_digit(c);
+  unsigned long codepoint;
+
+  if (digit < 0) {
+    json_stream_fail(stream, json_parse_error_invalid_string_escape_sequence,
+                     offset);
+    return;
+  }
+
+  stream->codepoint = stream->codepoint * 16 + (unsigned long)digit;
+  if (++stream->codepoint_digits < 4) {
+    return;
+  }
+
+  codepoint = stream->codepoint;
+  stream->state = json_stream_state_string;
+
+  if (codepoint >= 0xd800 && codepoint <= 0xdbff) { /* high surrogate. */
+    if (stream->high_surrogate) {
+      json_stream_fail(stream, json_parse_error_invalid_string_escape_sequence,
+                       offset);
+      return;
+    }
+
+    /* we need the low half to form a complete codepoint. */
+    stream->high_surrogate = codepoint;
+    return;
+  }
+
+  if (codepoint >= 0xdc00 && codepoint <= 0xdfff) { /* low surrogate. */
+    if (!stream->high_surrogate) {
+      json_stream_fail(stream, json_parse_error_invalid_string_escape_sequence,
+                       offset);
+      return;
+    }
+
+    codepoint = 0x10000u + ((stream->high_surrogate - 0xd800u) << 10) +
+                (codepoint - 0xdc00u);
+    stream->high_surrogate = 0;
+  }
+
+  json_stream_append_codepoint(stream, codepoint);
+}
+
+struct json_stream_s *json_stream_create(json_stream_callback_t callback,
+                                         void *user_data) {
+  struct json_stream_s *stream =
+      (struct json_stream_s *)malloc(sizeof(struct json_stream_s));
+
+  if (json_null == stream) {
+    return json_null;
+  }
+
+  memset(stream, 0, sizeof(struct json_stream_s));
+  stream->callback = callback;
+  stream->user_data = user_data;
+  stream->state = json_stream_state_value;
+  stream->error = json_parse_error_none;
+  stream->line_no = 1;
+  return stream;
+}
+
+size_t json_stream_feed(struct json_stream_s *stream, const void *src,
+                        size_t src_size) {
+  const char *const begin = (const char *)src;
+  const char *const end = begin + src_size;
+  const char *p = begin;
+
+  while (p < end && json_parse_error_none == stream->error) {
+    const char c = *p;
+    const size_t offset = stream->offset + (size_t)(p - begin);
+
+    if (stream->state <= json_stream_state_done) {
+      /* the only valid whitespace according to ECMA-404 is ' ', '\n', '\r'
+       * and '\t'. */
+      if (' ' == c || '\r' == c || '\t' == c) {
+        p++;
+        continue;
+      }
+
+      if ('\n' == c) {
+        stream->line_no++;
+        stream->line_offset = offset;
+        p++;
+        continue;
+      }
+    }
+
+    switch (stream->state) {
+    case json_stream_state_value:
+      json_stream_begin_value(stream, c, offset);
+      p++;
+      break;
+    case json_stream_state_value_or_close:
+      if (']' == c) {
+        json_stream_close(stream, c, offset);
+      } else {
+        json_stream_begin_value(stream, c, offset);
+      }
+      p++;
+      break;
+    case json_stream_state_key_or_close:
+    case json_stream_state_key:
+      if ('"' == c) {
+        json_stream_begin_string(stream, 1);
+      } else if ('}' == c && json_stream_state_key_or_close == stream->state) {
+        json_stream_close(stream, c, offset);
+      } else {
+        json_stream_fail(stream, json_parse_error_expected_opening_quote,
+                         offset);
+      }
+      p++;
+      break;
+    case json_stream_state_colon:
+      if (':' == c) {
+        stream->state = json_stream_state_value;
+      } else {
+        json_stream_fail(stream, json_parse_error_expected_colon, offset);
+      }
+      p++;
+      break;
+    case json_stream_state_comma_or_close:
+      if (',' == c) {
+        stream->state = '[' == stream->stack[stream->depth - 1].bracket
+                            ? json_stream_state_value
+                            : json_stream_state_key;
+      } else if ('}' == c || ']' == c) {
+        json_stream_close(stream, c, offset);
+      } else {
+        json_stream_fail(stream,
+                         json_parse_error_expected_comma_or_closing_bracket,
+                         offset);
+      }
+      p++;
+      break;
+    case json_stream_state_done:
+      json_stream_fail(stream, json_parse_error_unexpected_trailing_characters,
+                       offset);
+      break;
+    case json_stream_state_string: {
+      const char *run = p;
+
+      if (stream->high_surrogate && '\\' != c) {
+        /* a high surrogate has to be followed by its low half. */
+        json_stream_fail(stream,
+                         json_parse_error_invalid_string_escape_sequence,
+                         offset);
+        break;
+      }
+
+      /* copy the run of plain characters in one go. */
+      p = begin + json_find_string_special(begin, (size_t)(p - begin),
+                                           src_size, '"');
+
+      if (run != p) {
+        json_stream_append(stream, run, (size_t)(p - run));
+      } else if ('"' == c) {
+        json_stream_end_string(stream);
+        p++;
+      } else if ('\\' == c) {
+        stream->state = json_stream_state_escape;
+        p++;
+      } else if ('\0' == c || '\t' == c) {
+        json_stream_fail(stream, json_parse_error_invalid_string, offset);
+      } else if ('\r' == c || '\n' == c) {
+        /* strings do not span lines, json_parse reports the same error. */
+        json_stream_fail(stream,
+                         json_parse_error_invalid_string_escape_sequence,
+                         offset);
+      } else {
+        /* like json_parse, other control characters are kept as they are. */
+        json_stream_append(stream, p, 1);
+        p++;
+      }
+    } break;
+    case json_stream_state_escape:
+      json_stream_escape(stream, c, offset);
+      p++;
+      break;
+    case json_stream_state_unicode:
+      json_stream_unicode(stream, c, offset);
+      p++;
+      break;
+    case json_stream_state_number: {
+      const char *run = p;
+
+      while (p < end && (('0' <= *p && *p <= '9') || '.' == *p || 'e' == *p ||
+                         'E' == *p || '+' == *p || '-' == *p)) {
+        p++;
+      }
+
+      if (run != p) {
+        json_stream_append(stream, run, (size_t)(p - run));
+      } else {
+        /* the character after the number belongs to the next token. */
+        json_stream_end_number(stream, offset);
+      }
+    } break;
+    case json_stream_state_literal:
+      if (c != stream->literal[stream->literal_matched]) {
+        json_stream_fail(stream, json_parse_error_invalid_value, offset);
+        break;
+      }
+
+      p++;
+      if ('\0' == stream->literal[++stream->literal_matched]) {
+        json_stream_emit(stream, stream->literal_event, json_null, 0);
+        json_stream_end_value(stream);
+      }
+      break;
+    }
+  }
+
+  stream->offset += src_size;
+  return stream->error;
+}
+
+struct json_value_s *
+json_stream_finish(struct json_stream_s *stream,
+                   struct json_parse_result_s *result) {
+  return json_stream_finish_ex(stream, json_null, json_null, result);
+}
+
+struct json_value_s *
+json_stream_finish_ex(struct json_stream_s *stream,
+                      void *(*alloc_func_ptr)(void *user_data, size_t size),
+                      void *user_data, struct json_parse_result_s *result) {
+  struct json_value_s *root = json_null;
+
+  /* a number at the very end has nothing after it that would end it. */
+  if (json_parse_error_none == stream->error &&
+      json_stream_state_number == stream->state) {
+    json_stream_end_number(stream, stream->offset);
+  }
+
+  if (json_parse_error_none == stream->error &&
+      json_stream_state_done != stream->state) {
+    json_stream_fail(stream, json_parse_error_premature_end_of_buffer,
+                     stream->offset);
+  }
+
+  if (json_parse_error_none == stream->error && json_null == stream->callback) {
+    if (json_null == alloc_func_ptr) {
+      root = (struct json_value_s *)malloc(stream->dom.size);
+    } else {
+      root = (struct json_value_s *)alloc_func_ptr(user_data, stream->dom.size);
+    }
+
+    if (json_null == root) {
+      json_stream_fail(stream, json_parse_error_allocator_failed, 0);
+    } else {
+      memcpy(root, stream->dom.data, stream->dom.size);
+      json_dom_relocate((char *)root, root, 1);
+    }
+  }
+
+  if (result) {
+    result->error = stream->error;
+    result->error_offset = stream->error_offset;
+    result->error_line_no = stream->error_line_no;
+    result->error_row_no = stream->error_row_no;
+  }
+
+  return root;
+}
+
+void json_stream_reset(struct json_stream_s *stream) {
+  stream->state = json_stream_state_value;
+  stream->error = json_parse_error_none;
+  stream->error_offset = 0;
+  stream->error_line_no = 0;
+  stream->error_row_no = 0;
+  stream->offset = 0;
+  stream->line_no = 1;
+  stream->line_offset = 0;
+  stream->depth = 0;
+  stream->token_size = 0;
+  stream->high_surrogate = 0;
+  stream->dom.size = 0;
+  stream->key = 0;
+}
+
+void json_stream_destroy(struct json_stream_s *stream) {
+  if (json_null == stream) {
+    return;
+  }
+
+  free(stream->stack);
+  free(stream->token);
+  free(stream->dom.data);
+  free(stream);
+}
+
+/* A key on the way from the root object to the value being looked at. */
+struct json_select_path_s {
+  const char *key;
+  size_t key_size;
+  const struct json_select_path_s *parent;
+};
+
+struct json_select_state_s {
+  const char *src;
+  size_t size;
+  size_t offset;
+  size_t error;
+  struct json_field_s *fields;
+  size_t num_fields;
+  size_t remaining;
+};
+
+/* Returns where path continues after the keys of chain, pointing at '\0' if
+ * chain is the whole path or at '.' if the path goes deeper, or null if chain
+ * is not on the path. */
+json_weak const char *
+json_select_path_rest(const char *path,
+                      const struct json_select_path_s *chain);
+const char *json_select_path_rest(const char *path,
+                                  const struct json_select_path_s *chain) {
+  if (json_null == chain) {
+    return path;
+  }
+
+  path = json_select_path_rest(path, chain->parent);
+  if (json_null == path) {
+    return json_null;
+  }
+
+  if (json_null != chain->parent) {
+    if ('.' != *path) {
+      return json_null;
+    }
+    path++;
+  }
+
+  if (0 != strncmp(path, chain->key, chain->key_size)) {
+    return json_null;
+  }
+
+  path += chain->key_size;
+  if ('\0' != *path && '.' != *path) {
+    return json_null;
+  }
+
+  return path;
+}
+
+json_weak void json_select_skip_whitespace(struct json_select_state_s *state);
+void json_select_skip_whitespace(struct json_select_state_s *state) {
+  while (state->offset < state->size) {
+    switch (state->src[state->offset]) {
+    default:
+      return;
+    case ' ':
+    case '\r':
+    case '\t':
+    case '\n':
+      state->offset++;
+      break;
+    }
+  }
+}
+
+/* Skips the string starting at offset by searching for its closing quote. */
+json_weak int json_select_skip_string(struct json_select_state_s *state);
+int json_select_skip_string(struct json_select_state_s *state) {
+  const char *const start = state->src + state->offset + 1;
+  const char *const end = state->src + state->size;
+  const char *p = start;
+
+  for (;;) {
+    const char *quote = (const char *)memchr(p, '"', (size_t)(end - p));
+    const char *backslash;
+
+    if (json_null == quote) {
+      state->error = json_parse_error_premature_end_of_buffer;
+      state->offset = state->size;
+      return 0;
+    }
+
+    /* the quote is escaped if an odd number of backslashes precede it. */
+    backslash = quote;
+    while (backslash > start && '\\' == backslash[-1]) {
+      backslash--;
+    }
+
+    if (0 == ((quote - backslash) & 1)) {
+      state->offset = (size_t)(quote + 1 - state->src);
+      return 1;
+    }
+
+    p = quote + 1;
+  }
+}
+
+/* Skips the value starting at offset, only looking for where it ends. */
+json_weak int json_select_skip_value(struct json_select_state_s *state);
+int json_select_skip_value(struct json_select_state_s *state) {
+  const char *const src = state->src;
+  const size_t start = state->offset;
+  size_t depth = 0;
+
+  switch (src[state->offset]) {
+  case '"':
+    return json_select_skip_string(state);
+  case '{':
+  case '[':
+    do {
+      switch (src[state->offset]) {
+      case '"':
+        if (!json_select_skip_string(state)) {
+          return 0;
+        }
+        continue;
+      case '{':
+      case '[':
+        depth++;
+        break;
+      case '}':
+      case ']':
+        depth--;
+        break;
+      default:
+        break;
+      }
+      state->offset++;
+    } while (0 != depth && state->offset < state->size);
+
+    if (0 != depth) {
+      state->error = json_parse_error_premature_end_of_buffer;
+      return 0;
+    }
+    return 1;
+  default:
+    /* numbers and literals run up to the next delimiter. */
+    while (state->offset < state->size) {
+      const char c = src[state->offset];
+      if (',' == c || '}' == c || ']' == c || ' ' == c || '\r' == c ||
+          '\t' == c || '\n' == c) {
+        break;
+      }
+      state->offset++;
+    }
+
+    if (start == state->offset) {
+      state->error = json_parse_error_invalid_value;
+      return 0;
+    }
+    return 1;
+  }
+}
+
+json_weak void json_select_record(struct json_select_state_s *state,
+                                  struct json_field_s *field, size_t start);
+void json_select_record(struct json_select_state_s *state,
+                        struct json_field_s *field, size_t start) {
+  const char *const value = state->src + start;
+  const size_t size = state->offset - start;
+
+  switch (*value) {
+  case '"':
+    field->type = json_type_string;
+    field->value = value + 1;
+    field->value_size = size - 2;
+    break;
+  case '{':
+    field->type = json_type_object;
+    field->value = value;
+    field->value_size = size;
+    break;
+  case '[':
+    field->type = json_type_array;
+    field->value = value;
+    field->value_size = size;
+    break;
+  case 't':
+    field->type = json_type_true;
+    field->value = value;
+    field->value_size = size;
+    break;
+  case 'f':
+    field->type = json_type_false;
+    field->value = value;
+    field->value_size = size;
+    break;
+  case 'n':
+    field->type = json_type_null;
+    field->value = value;
+    field->value_size = size;
+    break;
+  default:
+    field->type = json_type_number;
+    field->value = value;
+    field->value_size = size;
+    break;
+  }
+
+  state->remaining--;
+}
+
+/* Walks the object starting at offset, parent is the path leading to it. */
+json_weak int json_select_object(struct json_select_state_s *state,
+                                 const struct json_select_path_s *parent);
+int json_select_object(struct json_select_state_s *state,
+                       const struct json_select_path_s *parent) {
+  const char *const src = state->src;
+
+  /* skip leading '{'. */
+  state->offset++;
+  json_select_skip_whitespace(state);
+
+  if (state->offset < state->size && '}' == src[state->offset]) {
+    state->offset++;
+    return 1;
+  }
+
+  for (;;) {
+    struct json_select_path_s path;
+    size_t value_start;
+    size_t i;
+    int descend = 0;
+
+    json_select_skip_whitespace(state);
+    if (state->offset >= state->size || '"' != src[state->offset]) {
+      state->error = state->offset >= state->size
+                         ? json_parse_error_premature_end_of_buffer
+                         : json_parse_error_expected_opening_quote;
+      return 0;
+    }
+
+    path.key = src + state->offset + 1;
+    if (!json_select_skip_string(state)) {
+      return 0;
+    }
+    path.key_size = (size_t)(src + state->offset - 1 - path.key);
+    path.parent = parent;
+
+    json_select_skip_whitespace(state);
+    if (state->offset >= state->size || ':' != src[state->offset]) {
+      state->error = state->offset >= state->size
+                         ? json_parse_error_premature_end_of_buffer
+                         : json_parse_error_expected_colon;
+      return 0;
+    }
+
+    state->offset++;
+    json_select_skip_whitespace(state);
+    if (state->offset >= state->size) {
+      state->error = json_parse_error_premature_end_of_buffer;
+      return 0;
+    }
+
+    value_start = state->offset;
+    for (i = 0; i < state->num_fields; i++) {
+      const char *rest = json_select_path_rest(state->fields[i].path, &path);
+      if (json_null != rest && '.' == *rest) {
+        descend = 1;
+      }
+    }
+
+    if (descend && '{' == src[value_start]) {
+      if (!json_select_object(state, &path)) {
+        return 0;
+      }
+    } else if (!json_select_skip_value(state)) {
+      return 0;
+    }
+
+    for (i = 0; i < state->num_fields; i++) {
+      struct json_field_s *field = &state->fields[i];
+      const char *rest = json_select_path_rest(field->path, &path);
+      if (json_null != rest && '\0' == *rest && json_null == field->value) {
+        json_select_record(state, field, value_start);
+      }
+    }
+
+    if (0 == state->remaining) {
+      /* everything was found, the rest of the input does not matter. */
+      return 1;
+    }
+
+    json_select_skip_whitespace(state);
+    if (state->offset >= state->size) {
+      state->error = json_parse_error_premature_end_of_buffer;
+      return 0;
+    }
+
+    switch (src[state->offset++]) {
+    case ',':
+      break;
+    case '}':
+      return 1;
+    default:
+      state->error = json_parse_error_expected_comma_or_closing_bracket;
+      return 0;
+    }
+  }
+}
+
+size_t json_select_fields(const void *src, size_t src_size,
+                          struct json_field_s *fields, size_t num_fields) {
+  struct json_select_state_s state;
+  size_t i;
+
+  for (i = 0; i < num_fields; i++) {
+    fields[i].type = json_type_null;
+    fields[i].value = json_null;
+    fields[i].value_size = 0;
+  }
+
+  state.src = (const char *)src;
+  state.size = src_size;
+  state.offset = 0;
+  state.error = json_parse_error_none;
+  state.fields = fields;
+  state.num_fields = num_fields;
+  state.remaining = num_fields;
+
+  json_select_skip_whitespace(&state);
+  if (state.offset >= state.size) {
+    return json_parse_error_premature_end_of_buffer;
+  }
+
+  /* only the keys of objects can be selected, other roots hold no fields. */
+  if ('{' == state.src[state.offset]) {
+    json_select_object(&state, json_null);
+  } else {
+    json_select_skip_value(&state);
+  }
+
+  if (json_parse_error_none == state.error && 0 != state.remaining) {
+    json_select_skip_whitespace(&state);
+    if (state.offset != state.size) {
+      state.error = json_parse_error_unexpected_trailing_characters;
+    }
+  }
+
+  return state.error;
+}
+
+size_t json_unescape_string(const char *src, size_t src_size, char *dst) {
+  const char *const end = src + src_size;
+  size_t size = 0;
+  unsigned long high_surrogate = 0;
+
+  while (src < end) {
+    const char *backslash =
+        (const char *)memchr(src, '\\', (size_t)(end - src));
+    unsigned long codepoint;
+
+    if (json_null == backslash) {
+      backslash = end;
+    }
+
+    /* copy the run up to the next escape in one go. */
+    memcpy(dst + size, src, (size_t)(backslash - src));
+    size += (size_t)(backslash - src);
+    src = backslash;
+
+    if (src + 1 >= end) {
+      break;
+    }
+
+    switch (src[1]) {
+    default:
+      /* not a valid escape, keep it as it is. */
+      dst[size++] = *src++;
+      continue;
+    case '"':
+    case '\\':
+    case '/':
+      dst[size++] = src[1];
+      break;
+    case 'b':
+      dst[size++] = '\b';
+      break;
+    case 'f':
+      dst[size++] = '\f';
+      break;
+    case 'n':
+      dst[size++] = '\n';
+      break;
+    case 'r':
+      dst[size++] = '\r';
+      break;
+    case 't':
+      dst[size++] = '\t';
+      break;
+    case 'u':
+      codepoint = 0;
+      if (end - src < 6 || !json_hexadecimal_value(src + 2, 4, &codepoint)) {
+        dst[size++] = *src++;
+        continue;
+      }
+
+      src += 6;
+
+      if (codepoint >= 0xd800 && codepoint <= 0xdbff) { /* high surrogate. */
+        /* we need the low half to form a complete codepoint. */
+        high_surrogate = codepoint;
+        continue;
+      }
+
+      if (codepoint >= 0xdc00 && codepoint <= 0xdfff && high_surrogate) {
+        codepoint = 0x10000u + ((high_surrogate - 0xd800u) << 10) +
+                    (codepoint - 0xdc00u);
+      }
+      high_surrogate = 0;
+      size += json_encode_utf8(codepoint, dst + size);
+      continue;
+    }
+
+    src += 2;
+  }
+
+  dst[size] = '\0';
+  return size;
+}
+
+struct json_in_situ_state_s {
+  char *src;
+  size_t size;
+  size_t offset;
+  size_t line_no;
+  size_t line_offset;
+  size_t error;
+  struct json_dom_buffer_s dom;
+};
+
+json_weak int json_in_situ_fail(struct json_in_situ_state_s *state,
+                                size_t error);
+int json_in_situ_fail(struct json_in_situ_state_s *state, size_t error) {
+  state->error = error;
+  return 0;
+}
+
+json_weak void
+json_in_situ_skip_whitespace(struct json_in_situ_state_s *state);
+void json_in_situ_skip_whitespace(struct json_in_situ_state_s *state) {
+  state->offset =
+      json_find_non_whitespace(state->src, state->offset, state->size,
+                               &state->line_no, &state->line_offset);
+}
+
+/* Parse the string starting at the current '"' into the json_string_s at
+ * offset string of the DOM, unescaping it over its own characters. */
+json_weak int json_in_situ_string(struct json_in_situ_state_s *state,
+                                  size_t string);
+int json_in_situ_string(struct json_in_situ_state_s *state, size_t string) {
+  char *const src = state->src;
+  const size_t size = state->size;
+  const size_t start = state->offset + 1;
+  size_t read = start;
+  size_t write = start;
+  unsigned long high_surrogate = 0;
+  struct json_string_s *string_ptr;
+
+  for (;;) {
+    const size_t special = json_find_string_special(src, read, size, '"');
+    unsigned long codepoint;
+
+    if (high_surrogate && special != read) {
+      /* a high surrogate has to be followed by its low half right away. */
+      state->offset = read;
+      return json_in_situ_fail(state,
+                               json_parse_error_invalid_string_escape_sequence);
+    }
+
+    /* once an escape made the string shorter the runs have to move down. */
+    if (write != read) {
+      memmove(src + write, src + read, special - read);
+    }
+    write += special - read;
+    read = special;
+    state->offset = read;
+
+    if (read >= size) {
+      return json_in_situ_fail(state, json_parse_error_premature_end_of_buffer);
+    }
+
+    if (high_surrogate && '\\' != src[read]) {
+      /* a high surrogate has to be followed by its low half. */
+      return json_in_situ_fail(state,
+                               json_parse_error_invalid_string_escape_sequence);
+    }
+
+    if ('"' == src[read]) {
+      break;
+    }
+
+    if ('\0' == src[read] || '\t' == src[read]) {
+      return json_in_situ_fail(state, json_parse_error_invalid_string);
+    }
+
+    if ('\r' == src[read] || '\n' == src[read]) {
+      /* strings do not span lines, json_parse reports the same error. */
+      return json_in_situ_fail(state,
+                               json_parse_error_invalid_string_escape_sequence);
+    }
+
+    if ('\\' != src[read]) {
+      /* like json_parse, other control characters are kept as they are. */
+      src[write++] = src[read++];
+      continue;
+    }
+
+    if (read + 1 >= size) {
+      return json_in_situ_fail(state, json_parse_error_premature_end_of_buffer);
+    }
+
+    state->offset = read + 1;
+    if (high_surrogate && 'u' != src[read + 1]) {
+      return json_in_situ_fail(state,
+                               json_parse_error_invalid_string_escape_sequence);
+    }
+
+    switch (src[read + 1]) {
+    case '"':
+    case '\\':
+    case '/':
+      src[write++] = src[read + 1];
+      break;
+    case 'b':
+      src[write++] = '\b';
+      break;
+    case 'f':
+      src[write++] = '\f';
+      break;
+    case 'n':
+      src[write++] = '\n';
+      break;
+    case 'r':
+      src[write++] = '\r';
+      break;
+    case 't':
+      src[write++] = '\t';
+      break;
+    case 'u':
+      codepoint = 0;
+      if (size - read < 6 ||
+          !json_hexadecimal_value(src + read + 2, 4, &codepoint)) {
+        return json_in_situ_fail(
+            state, json_parse_error_invalid_string_escape_sequence);
+      }
+
+      read += 6;
+
+      if (codepoint >= 0xd800 && codepoint <= 0xdbff) { /* high surrogate. */
+        if (high_surrogate) {
+          return json_in_situ_fail(
+              state, json_parse_error_invalid_string_escape_sequence);
+        }
+
+        /* we need the low half to form a complete codepoint. */
+        high_surrogate = codepoint;
+        continue;
+      }
+
+      if (codepoint >= 0xdc00 && codepoint <= 0xdfff) { /* low surrogate. */
+        if (!high_surrogate) {
+          return json_in_situ_fail(
+              state, json_parse_error_invalid_string_escape_sequence);
+        }
+
+        codepoint = 0x10000u + ((high_surrogate - 0xd800u) << 10) +
+                    (codepoint - 0xdc00u);
+        high_surrogate = 0;
+      }
+
+      /* a \u escape takes 6 bytes and its utf-8 encoding at most 4. */
+      write += json_encode_utf8(codepoint, src + write);
+      continue;
+    default:
+      return json_in_situ_fail(state,
+                               json_parse_error_invalid_string_escape_sequence);
+    }
+
+    read += 2;
+  }
+
+  /* the closing quote (or a byte before it) becomes the terminator. */
+  src[write] = '\0';
+  state->offset = read + 1;
+
+  string_ptr = (struct json_string_s *)(state->dom.data + string);
+  string_ptr->string = (const char *)(src + start);
+  string_ptr->string_size = write - start;
+  return 1;
+}
+
+json_weak int json_in_situ_value(struct json_in_situ_state_s *state,
+                                 size_t value);
+
+json_weak int json_in_situ_object(struct json_in_situ_state_s *state,
+                                  size_t value);
+int json_in_situ_object(struct json_in_situ_state_s *state, size_t value) {
+  struct json_value_s *value_ptr;
+  size_t object;
+  size_t last = 0;
+
+  if (!json_dom_alloc(&state->dom, sizeof(struct json_object_s), &object)) {
+    return json_in_situ_fail(state, json_parse_error_allocator_failed);
+  }
+
+  value_ptr = (struct json_value_s *)(state->dom.data + value);
+  value_ptr->type = json_type_object;
+  value_ptr->payload = (void *)object;
+
+  state->offset++;
+  json_in_situ_skip_whitespace(state);
+  if (state->offset < state->size && '}' == state->src[state->offset]) {
+    state->offset++;
+    return 1;
+  }
+
+  for (;;) {
+    struct json_object_element_s *element_ptr;
+    size_t element;
+    size_t name;
+    size_t element_value;
+
+    json_in_situ_skip_whitespace(state);
+    if (state->offset >= state->size) {
+      return json_in_situ_fail(state, json_parse_error_premature_end_of_buffer);
+    }
+
+    if ('"' != state->src[state->offset]) {
+      return json_in_situ_fail(state, json_parse_error_expected_opening_quote);
+    }
+
+    if (!json_dom_alloc(&state->dom, sizeof(struct json_object_element_s),
+                        &element) ||
+        !json_dom_alloc(&state->dom, sizeof(struct json_string_s), &name) ||
+        !json_dom_alloc(&state->dom, sizeof(struct json_value_s),
+                        &element_value)) {
+      return json_in_situ_fail(state, json_parse_error_allocator_failed);
+    }
+
+    element_ptr = (struct json_object_element_s *)(state->dom.data + element);
+    element_ptr->name = (struct json_string_s *)name;
+    element_ptr->value = (struct json_value_s *)element_value;
+
+    if (last) {
+      ((struct json_object_element_s *)(state->dom.data + last))->next =
+          (struct json_object_element_s *)element;
+    } else {
+      ((struct json_object_s *)(state->dom.data + object))->start =
+          (struct json_object_element_s *)element;
+    }
+    ((struct json_object_s *)(state->dom.data + object))->length++;
+    last = element;
+
+    if (!json_in_situ_string(state, name)) {
+      return 0;
+    }
+
+    json_in_situ_skip_whitespace(state);
+    if (state->offset >= state->size) {
+      return json_in_situ_fail(state, json_parse_error_premature_end_of_buffer);
+    }
+
+    if (':' != state->src[state->offset]) {
+      return json_in_situ_fail(state, json_parse_error_expected_colon);
+    }
+
+    state->offset++;
+    json_in_situ_skip_whitespace(state);
+    if (!json_in_situ_value(state, element_value)) {
+      return 0;
+    }
+
+    json_in_situ_skip_whitespace(state);
+    if (state->offset >= state->size) {
+      return json_in_situ_fail(state, json_parse_error_premature_end_of_buffer);
+    }
+
+    if ('}' == state->src[state->offset]) {
+      state->offset++;
+      return 1;
+    }
+
+    if (',' != state->src[state->offset]) {
+      return json_in_situ_fail(
+          state, json_parse_error_expected_comma_or_closing_bracket);
+    }
+
+    state->offset++;
+  }
+}
+
+json_weak int json_in_situ_array(struct json_in_situ_state_s *state,
+                                 size_t value);
+int json_in_situ_array(struct json_in_situ_state_s *state, size_t value) {
+  struct json_value_s *value_ptr;
+  size_t array;
+  size_t last = 0;
+
+  if (!json_dom_alloc(&state->dom, sizeof(struct json_array_s), &array)) {
+    return json_in_situ_fail(state, json_parse_error_allocator_failed);
+  }
+
+  value_ptr = (struct json_value_s *)(state->dom.data + value);
+  value_ptr->type = json_type_array;
+  value_ptr->payload = (void *)array;
+
+  state->offset++;
+  json_in_situ_skip_whitespace(state);
+  if (state->offset < state->size && ']' == state->src[state->offset]) {
+    state->offset++;
+    return 1;
+  }
+
+  for (;;) {
+    size_t element;
+    size_t element_value;
+
+    if (!json_dom_alloc(&state->dom, sizeof(struct json_array_element_s),
+                        &element) ||
+        !json_dom_alloc(&state->dom, sizeof(struct json_value_s),
+                        &element_value)) {
+      return json_in_situ_fail(state, json_parse_error_allocator_failed);
+    }
+
+    ((struct json_array_element_s *)(state->dom.data + element))->value =
+        (struct json_value_s *)element_value;
+
+    if (last) {
+      ((struct json_array_element_s *)(state->dom.data + last))->next =
+          (struct json_array_element_s *)element;
+    } else {
+      ((struct json_array_s *)(state->dom.data + array))->start =
+          (struct json_array_element_s *)element;
+    }
+    ((struct json_array_s *)(state->dom.data + array))->length++;
+    last = element;
+
+    json_in_situ_skip_whitespace(state);
+    if (!json_in_situ_value(state, element_value)) {
+      return 0;
+    }
+
+    json_in_situ_skip_whitespace(state);
+    if (state->offset >= state->size) {
+      return json_in_situ_fail(state, json_parse_error_premature_end_of_buffer);
+    }
+
+    if (']' == state->src[state->offset]) {
+      state->offset++;
+      return 1;
+    }
+
+    if (',' != state->src[state->offset]) {
+      return json_in_situ_fail(
+          state, json_parse_error_expected_comma_or_closing_bracket);
+    }
+
+    state->offset++;
+  }
+}
+
+json_weak int json_in_situ_literal(struct json_in_situ_state_s *state,
+                                   size_t value, const char *literal,
+                                   size_t type);
+int json_in_situ_literal(struct json_in_situ_state_s *state, size_t value,
+                         const char *literal, size_t type) {
+  const size_t literal_size = strlen(literal);
+
+  if (state->size - state->offset < literal_size ||
+      0 != memcmp(state->src + state->offset, literal, literal_size)) {
+    return json_in_situ_fail(state, json_parse_error_invalid_value);
+  }
+
+  state->offset += literal_size;
+  ((struct json_value_s *)(state->dom.data + value))->type = type;
+  return 1;
+}
+
+int json_in_situ_value(struct json_in_situ_state_s *state, size_t value) {
+  const char *const src = state->src;
+  struct json_value_s *value_ptr;
+  size_t payload;
+  size_t start;
+
+  if (state->offset >= state->size) {
+    return json_in_situ_fail(state, json_parse_error_premature_end_of_buffer);
+  }
+
+  switch (src[state->offset]) {
+  case '{':
+    return json_in_situ_object(state, value);
+  case '[':
+    return json_in_situ_array(state, value);
+  case 't':
+    return json_in_situ_literal(state, value, "true", json_type_true);
+  case 'f':
+    return json_in_situ_literal(state, value, "false", json_type_false);
+  case 'n':
+    return json_in_situ_literal(state, value, "null", json_type_null);
+  case '"':
+    if (!json_dom_alloc(&state->dom, sizeof(struct json_string_s), &payload)) {
+      return json_in_situ_fail(state, json_parse_error_allocator_failed);
+    }
+
+    value_ptr = (struct json_value_s *)(state->dom.data + value);
+    value_ptr->type = json_type_string;
+    value_ptr->payload = (void *)payload;
+    return json_in_situ_string(state, payload);
+  default:
+    break;
+  }
+
+  if ('-' != src[state->offset] &&
+      !('0' <= src[state->offset] && src[state->offset] <= '9')) {
+    return json_in_situ_fail(state, json_parse_error_invalid_value);
+  }
+
+  start = state->offset;
+  while (state->offset < state->size &&
+         (('0' <= src[state->offset] && src[state->offset] <= '9') ||
+          '.' == src[state->offset] || 'e' == src[state->offset] ||
+          'E' == src[state->offset] || '+' == src[state->offset] ||
+          '-' == src[state->offset])) {
+    state->offset++;
+  }
+
+  if (!json_is_strict_number(src + start, state->offset - start)) {
+    state->offset = start;
+    return json_in_situ_fail(state, json_parse_error_invalid_number_format);
+  }
+
+  /* the byte after a number still has to be parsed, so unlike strings numbers
+   * are copied into the DOM to get their terminator. */
+  if (!json_dom_string(&state->dom, src + start, state->offset - start,
+                       &payload)) {
+    return json_in_situ_fail(state, json_parse_error_allocator_failed);
+  }
+
+  value_ptr = (struct json_value_s *)(state->dom.data + value);
+  value_ptr->type = json_type_number;
+  value_ptr->payload = (void *)payload;
+  return 1;
+}
+
+struct json_value_s *
+json_parse_in_situ(void *src, size_t src_size,
+                   void *(*alloc_func_ptr)(void *user_data, size_t size),
+                   void *user_data, struct json_parse_result_s *result) {
+  struct json_in_situ_state_s state;
+  struct json_value_s *root = json_null;
+  size_t value;
+
+  if (result) {
+    result->error = json_parse_error_none;
+    result->error_offset = 0;
+    result->error_line_no = 0;
+    result->error_row_no = 0;
+  }
+
+  if (json_null == src) {
+    /* invalid src pointer was null! */
+    return json_null;
+  }
+
+  state.src = (char *)src;
+  state.size = src_size;
+  state.offset = 0;
+  state.line_no = 1;
+  state.line_offset = 0;
+  state.error = json_parse_error_none;
+  state.dom.data = json_null;
+  state.dom.size = 0;
+  state.dom.capacity = 0;
+
+  /* the root value sits at offset 0 of the DOM. */
+  if (!json_dom_alloc(&state.dom, sizeof(struct json_value_s), &value)) {
+    json_in_situ_fail(&state, json_parse_error_allocator_failed);
+  } else {
+    json_in_situ_skip_whitespace(&state);
+    if (json_in_situ_value(&state, value)) {
+      json_in_situ_skip_whitespace(&state);
+      if (state.offset != state.size) {
+        json_in_situ_fail(&state,
+                          json_parse_error_unexpected_trailing_characters);
+      }
+    }
+  }
+
+  if (json_parse_error_none == state.error) {
+    if (json_null == alloc_func_ptr) {
+      root = (struct json_value_s *)state.dom.data;
+      state.dom.data = json_null;
+    } else {
+      root = (struct json_value_s *)alloc_func_ptr(user_data, state.dom.size);
+      if (json_null == root) {
+        state.error = json_parse_error_allocator_failed;
+      } else {
+        memcpy(root, state.dom.data, state.dom.size);
+      }
+    }
+  }
+
+  free(state.dom.data);
+
+  if (json_null == root) {
+    if (result) {
+      result->error = state.error;
+
+      /* like json_parse_ex, allocation failures have no location. */
+      if (json_parse_error_allocator_failed != state.error) {
+        result->error_offset = state.offset;
+        result->error_line_no = state.line_no;
+        result->error_row_no = state.offset - state.line_offset;
+      }
+    }
+
+    return json_null;
+  }
+
+  json_dom_relocate((char *)root, root, 0);
+  return root;
+}
+
+struct json_extract_result_s {
+  size_t dom_size;
+  size_t data_size;
+};
+
+struct json_value_s *json_extract_value(const struct json_value_s *value) {
+  return json_extract_value_ex(value, json_null, json_null);
+}
+
+json_weak struct json_extract_result_s
+json_extract_get_number_size(const struct json_number_s *const number);
+json_weak struct json_extract_result_s
+json_extract_get_string_size(const struct json_string_s *const string);
+json_weak struct json_extract_result_s
+json_extract_get_object_size(const struct json_object_s *const object);
+json_weak struct json_extract_result_s
+json_extract_get_array_size(const struct json_array_s *const array);
+json_weak struct json_extract_result_s
+json_extract_get_value_size(const struct json_value_s *const value);
+
+struct json_extract_result_s
+json_extract_get_number_size(const struct json_number_s *const number) {
+  struct json_extract_result_s result;
+  result.dom_size = sizeof(struct json_number_s);
+  result.data_size = number->number_size;
+  return result;
+}
+
+struct json_extract_result_s
+json_extract_get_string_size(const struct json_string_s *const string) {
+  struct json_extract_result_s result;
+  result.dom_size = sizeof(struct json_string_s);
+  result.data_size = string->string_size + 1;
+  return result;
+}
+
+struct json_extract_result_s
+json_extract_get_object_size(const struct json_object_s *const object) {
+  struct json_extract_result_s result;
+  size_t i;
+  const struct json_object_element_s *element = object->start;
+
+  result.dom_size = sizeof(struct json_object_s) +
+                    (sizeof(struct json_object_element_s) * object->length);
+  result.data_size = 0;
+
+  for (i = 0; i < object->length; i++) {
+    const struct json_extract_result_s string_result =
+        json_extract_get_string_size(element->name);
+    const struct json_extract_result_s value_result =
+        json_extract_get_value_size(element->value);
+
+    result.dom_size += string_result.dom_size;
+    result.data_size += string_result.data_size;
+
+    result.dom_size += value_result.dom_size;
+    result.data_size += value_result.data_size;
+
+    element = element->next;
+  }
+
+  return result;
+}
+
+struct json_extract_result_s
+json_extract_get_array_size(const struct json_array_s *const array) {
+  struct json_extract_result_s result;
+  size_t i;
+  const struct json_array_element_s *element = array->start;
+
+  result.dom_size = sizeof(struct json_array_s) +
+                    (sizeof(struct json_array_element_s) * array->length);
+  result.data_size = 0;
+
+  for (i = 0; i < array->length; i++) {
+    const struct json_extract_result_s value_result =
+        json_extract_get_value_size(element->value);
+
+    result.dom_size += value_result.dom_size;
+    result.data_size += value_result.data_size;
+
+    element = element->next;
+  }
+
+  return result;
+}
+
+struct json_extract_result_s
+json_extract_get_value_size(const struct json_value_s *const value) {
+  struct json_extract_result_s result = {0, 0};
+
+  switch (value->type) {
+  default:
+    break;
+  case json_type_object:
+    result = json_extract_get_object_size(
+        (const struct json_object_s *)value->payload);
+    break;
+  case json_type_array:
+    result = json_extract_get_array_size(
+        (const struct json_array_s *)value->payload);
+    break;
+  case json_type_number:
+    result = json_extract_get_number_size(
+        (const struct json_number_s *)value->payload);
+    break;
+  case json_type_string:
+    result = json_extract_get_string_size(
+        (const struct json_string_s *)value->payload);
+    break;
+  }
+
+  result.dom_size += sizeof(struct json_value_s);
+
+  return result;
+}
+
+struct json_extract_state_s {
+  char *dom;
+  char *data;
+};
+
+json_weak void json_extract_copy_value(struct json_extract_state_s *const state,
+                                       const struct json_value_s *const value);
+void json_extract_copy_value(struct json_extract_state_s *const state,
+                             const struct json_value_s *const value) {
+  struct json_string_s *string;
+  struct json_number_s *number;
+  struct json_object_s *object;
   struct json_array_s *array;
   struct json_value_s *new_value;
 
@@ -2336,6 +4658,9 @@ void json_extract_copy_value(struct json_extract_state_s *const state,
     object = (struct json_object_s *)state->dom;
     state->dom += sizeof(struct json_object_s);
 
+    /* the copy is not indexed, the index would point at the original. */
+    object->index = json_null;
+
     element = object->start;
     object->start = (struct json_object_element_s *)state->dom;
 
@@ -2464,6 +4789,39 @@ struct json_array_s *json_value_as_array(struct json_value_s *const value) {
   return (struct json_array_s *)value->payload;
 }
 
+struct json_value_s *json_object_find(const struct json_object_s *const object,
+                                      const char *name, size_t name_size) {
+  const struct json_object_element_s *element;
+  size_t i;
+
+  if (json_null != object->index) {
+    const size_t mask = json_object_index_capacity(object->length) - 1;
+    size_t slot = json_hash_name(name, name_size) & mask;
+
+    /* the table is never full, so there is always an empty slot to stop at. */
+    for (; json_null != object->index[slot]; slot = (slot + 1) & mask) {
+      element = object->index[slot];
+      if (element->name->string_size == name_size &&
+          0 == memcmp(element->name->string, name, name_size)) {
+        return element->value;
+      }
+    }
+
+    return json_null;
+  }
+
+  element = object->start;
+  for (i = 0; i < object->length; i++) {
+    if (element->name->string_size == name_size &&
+        0 == memcmp(element->name->string, name, name_size)) {
+      return element->value;
+    }
+    element = element->next;
+  }
+
+  return json_null;
+}
+
 int json_value_is_true(const struct json_value_s *const value) {
   return value->type == json_type_true;
 }
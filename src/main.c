@@ -6,6 +6,11 @@
 #include <math.h>
 #include <curl/curl.h>
 #include "json.h"
+#include "fetch.h"
+#include "config.h"
+#include "store.h"
+#include "xkcd_info.h"
+#include "images.h"
 #include <assert.h>
 
 #define FPS 60
@@ -14,8 +19,18 @@
 
 #define ANIMATION_DURATION 0.6f
 #define MAX_NUM_XKCD 1024
+// Open addressing table from comic number to in-flight request, kept at most half full
+#define REQUEST_TABLE_SIZE (MAX_NUM_XKCD * 2)
 
 #define FONT_PATH "./font/Alegreya-Regular.ttf"
+#define STATS_FONT_SIZE 16.0f
+// How often a sync looks for finished transfers and reports its progress
+#define SYNC_POLL_MS 10
+#define SYNC_PROGRESS_MS 2000
+// Space between the border of a tile and its comic image
+#define IMAGE_PADDING 8.0f
+// New comics whose prefetch failed, remembered for the next poll
+#define MAX_MISSING_PREFETCHES 256
 
 typedef enum {
     ease_out_expo,
@@ -42,16 +57,42 @@ typedef struct {
     float size_y;
     float font_size;
     int index;
+    int xkcd_number;
+    int next_waiter; // Next tile waiting on the same request (-1 if this is the last one)
     bool loading;
+    bool failed; // The comic could not be fetched, even after retrying
+    bool has_image; // Holds a reference on the image of the comic
     TTF_Font* font;
-    char message[1024];
 } xkcd_t;
 
+typedef enum {
+    request_priority_offscreen,
+    request_priority_onscreen,
+    request_priority_hovered
+} request_priority;
+
+// One in-flight request per comic number, every tile showing that comic waits on it
 typedef struct {
-    int index;
+    bool in_use;
     int xkcd_number;
+    int first_waiter; // Index of the first waiting tile, the rest are chained through xkcd_t::next_waiter
+    request_priority priority;
+    fetch_job_t* job; // Set while the request is queued or in flight
+    bool cached; // The comic is already in the store, the waiters get it on the next frame
 } xkcd_request_t;
 
+// Space between the tiles of the newest comics wall
+#define WALL_MARGIN 16.0f
+
+// Progress of a headless --sync run
+typedef struct {
+    int latest; // Number of the newest comic, 0 until it is known
+    int pending; // Transfers that have not completed yet
+    int comics;
+    int images;
+    int failed;
+} sync_state_t;
+
 SDL_Renderer* renderer = NULL;
 SDL_Window* window = NULL;
 int window_width = 1280;
@@ -59,6 +100,8 @@ int window_height = 720;
 bool running = false;
 
 TTF_TextEngine* text_engine = NULL;
+TTF_Font* stats_font = NULL;
+bool show_stats = false;
 
 float mouse_x = 0.0f;
 float mouse_y = 0.0f;
@@ -71,8 +114,17 @@ float mouse_down_y = 0.0f;
 Uint64 start_time;
 float seconds_passed = 0.0f;
 
+sync_state_t sync_state = {0};
+
+// Background check for new comics
+fetch_job_t* latest_job = NULL;
+Uint64 next_latest_poll = 0;
+int missing_prefetches[MAX_MISSING_PREFETCHES];
+int num_missing_prefetches = 0;
+
 xkcd_t xkcds[MAX_NUM_XKCD];
 xkcd_request_t xkcd_requests[MAX_NUM_XKCD];
+int request_table[REQUEST_TABLE_SIZE]; // Request index + 1, 0 marks an empty slot
 int num_xkcds = 0;
 SDL_FRect xkcd_indication_rect = {0};
 
@@ -103,71 +155,290 @@ animation_t create_animation(float duration, animation_kind kind, bool reverse)
     return result;
 }
 
-char* get_string(struct json_value_s* root, const char* key, int* size) {
-    assert(root->type == json_type_object);
-    struct json_object_s* object = (struct json_object_s*) root->payload;
-    struct json_object_element_s* element = object->start;
-    while (element) {
-        if (element->value->type == json_type_string) {
-            if (strcmp(element->name->string, key) == 0) {
-                struct json_string_s* value = json_value_as_string(element->value);
-                char* buffer = (char*) malloc(sizeof(char) * value->string_size);
-                *size = value->string_size;
-                memcpy(buffer, value->string, value->string_size);
-                return buffer;
-            }
+static inline int request_table_slot(int xkcd_number) {
+    return (int) (((unsigned int) xkcd_number * 2654435761u) & (REQUEST_TABLE_SIZE - 1));
+}
+
+xkcd_request_t* find_request(int xkcd_number) {
+    for (int slot = request_table_slot(xkcd_number); request_table[slot]; slot = (slot + 1) & (REQUEST_TABLE_SIZE - 1)) {
+        xkcd_request_t* request = &xkcd_requests[request_table[slot] - 1];
+        if (request->xkcd_number == xkcd_number) {
+            return request;
         }
-        element = element->next;
     }
     return NULL;
 }
 
-static size_t write_callback(void* contents, size_t size, size_t bytes, void* data) {
-    xkcd_request_t* request  = (xkcd_request_t*) data;
-    size_t real_size = size * bytes;
-    char json[real_size];
-    memcpy(&json, contents, real_size);
-    struct json_value_s* root = json_parse(json, real_size);
-    assert(root->type == json_type_object);
-    int string_size;
-    char* title = get_string(root, "title", &string_size);
-    memcpy(xkcds[request->index].message, title, string_size);
-    free(root);
-    free(title);
-    xkcds[request->index].loading = false;
-    return real_size;
-}
-
-
-int make_xkcd_request(void* data) {
-    CURL* curl;
-    CURLcode res;
-    curl = curl_easy_init();
+xkcd_request_t* add_request(int xkcd_number) {
+    int index = 0;
+    while (index < MAX_NUM_XKCD && xkcd_requests[index].in_use) {
+        index++;
+    }
+    // There is at most one request per tile, so there is always a free one
+    assert(index < MAX_NUM_XKCD);
+    int slot = request_table_slot(xkcd_number);
+    while (request_table[slot]) {
+        slot = (slot + 1) & (REQUEST_TABLE_SIZE - 1);
+    }
+    request_table[slot] = index + 1;
+    xkcd_requests[index] = (xkcd_request_t) {
+        .in_use = true,
+        .xkcd_number = xkcd_number,
+        .first_waiter = -1
+    };
+    return &xkcd_requests[index];
+}
+
+void remove_request(xkcd_request_t* request) {
+    int index = (int) (request - xkcd_requests);
+    int slot = request_table_slot(request->xkcd_number);
+    while (request_table[slot] != index + 1) {
+        slot = (slot + 1) & (REQUEST_TABLE_SIZE - 1);
+    }
+    // Backward shift deletion, move later entries of the probe run into the hole so lookups never stop early
+    int hole = slot;
+    for (int next = (hole + 1) & (REQUEST_TABLE_SIZE - 1); request_table[next]; next = (next + 1) & (REQUEST_TABLE_SIZE - 1)) {
+        int home = request_table_slot(xkcd_requests[request_table[next] - 1].xkcd_number);
+        bool movable = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+        if (movable) {
+            request_table[hole] = request_table[next];
+            hole = next;
+        }
+    }
+    request_table[hole] = 0;
+    request->in_use = false;
+}
+
+// Hands the comic to every tile waiting on the request, they read it straight from the store from now on.
+// If the request failed for good the tiles stop loading too and show that instead
+void serve_waiters(xkcd_request_t* request, bool failed) {
+    for (int waiter = request->first_waiter; waiter >= 0; waiter = xkcds[waiter].next_waiter) {
+        xkcds[waiter].loading = false;
+        xkcds[waiter].failed = failed;
+    }
+    request->first_waiter = -1;
+}
+
+// Appends a decoded comic to the store together with the validators of its response
+bool store_info(const xkcd_info_t* info, const fetch_response_t* response) {
+    store_validators_t validators = {
+        .etag = { response->etag, response->etag ? SDL_strlen(response->etag) : 0 },
+        .last_modified = { response->last_modified, response->last_modified ? SDL_strlen(response->last_modified) : 0 }
+    };
+    bool stored = info->title.data != NULL && store_put(info, &validators);
+    if (!stored) {
+        SDL_Log("ERROR in storing xkcd %d", info->num);
+    }
+    return stored;
+}
+
+// Appends an info.0.json response, decoded by xkcd_info_decoder while it downloaded, to the store
+bool store_response(int xkcd_number, const fetch_response_t* response) {
+    const xkcd_info_t* decoded = xkcd_info_decoded(response->decoded);
+    if (decoded == NULL) {
+        SDL_Log("ERROR in parsing response for xkcd %d", xkcd_number);
+        return false;
+    }
+    xkcd_info_t info = *decoded;
+    info.num = xkcd_number;
+    return store_info(&info, response);
+}
+
+static void xkcd_request_done(const fetch_response_t* response, void* data) {
     xkcd_request_t* request  = (xkcd_request_t*) data;
+    int xkcd_number = request->xkcd_number;
+    request->job = NULL;
+    bool ok = response->ok;
+    if (!ok) {
+        SDL_Log("ERROR in fetching xkcd %d", xkcd_number);
+    }
+    else if (response->status == 304) {
+        // Not modified, the stored comic is still current and nothing was downloaded or parsed
+        store_touch(xkcd_number);
+    }
+    else {
+        ok = store_response(xkcd_number, response);
+    }
+    // Tiles of a stale comic have been served from the store already, a failed revalidation does not matter to them
+    serve_waiters(request, !ok);
+    remove_request(request);
+}
+
+// Requests served from the store complete here, one frame after they were made
+void dispatch_cached_requests(void) {
+    for (int i = 0; i < MAX_NUM_XKCD; i++) {
+        xkcd_request_t* request = &xkcd_requests[i];
+        if (!request->in_use || !request->cached) {
+            continue;
+        }
+        request->cached = false;
+        serve_waiters(request, false);
+        // A stale comic is shown right away, its request stays around until the revalidation is done
+        if (request->job == NULL) {
+            remove_request(request);
+        }
+    }
+}
+
+void make_xkcd_request(xkcd_request_t* request) {
+    const store_record_t* record = store_get(request->xkcd_number);
+    // Comics we have seen before are shown from the store, fresh ones never touch the network
+    request->cached = record != NULL;
+    if (record && store_is_fresh(record, config.metadata_ttl)) {
+        return;
+    }
+    // Stale comics are revalidated, the server answers with an empty 304 if they did not change
+    char* headers[3] = {0};
+    int num_headers = 0;
+    if (record && record->etag.size > 0) {
+        SDL_asprintf(&headers[num_headers++], "If-None-Match: %s", store_string(record->etag));
+    }
+    if (record && record->last_modified.size > 0) {
+        SDL_asprintf(&headers[num_headers++], "If-Modified-Since: %s", store_string(record->last_modified));
+    }
+    char* request_url = NULL;
+    SDL_asprintf(&request_url, "%s/%d/info.0.json", config.base_url, request->xkcd_number);
+    // Handed to the network thread, xkcd_request_done will get called with the response
+    request->job = fetch_submit_json(request_url, (const char* const*) headers, request->priority, &xkcd_info_decoder, xkcd_request_done, (void*) request);
+    SDL_free(request_url);
+    for (int i = 0; i < num_headers; i++) {
+        SDL_free(headers[i]);
+    }
+}
+
+void remember_missing_prefetch(int xkcd_number) {
+    if (num_missing_prefetches == MAX_MISSING_PREFETCHES) {
+        SDL_Log("ERROR in prefetching xkcd %d, it is loaded once it is shown", xkcd_number);
+        return;
+    }
+    SDL_Log("ERROR in prefetching xkcd %d, the next poll tries again", xkcd_number);
+    missing_prefetches[num_missing_prefetches++] = xkcd_number;
+}
+
+static void prefetch_done(const fetch_response_t* response, void* data) {
+    int xkcd_number = (int) (intptr_t) data;
+    // There is no comic 404, nothing to try again
+    if (store_get(xkcd_number) || response->status == 404) {
+        return;
+    }
+    if (!response->ok || !store_response(xkcd_number, response)) {
+        remember_missing_prefetch(xkcd_number);
+    }
+}
+
+// Fetches a comic into the store before any tile asks for it
+void prefetch(int xkcd_number) {
     char* request_url = NULL;
-    SDL_asprintf(&request_url, "https://xkcd.com/%d/info.0.json", request->xkcd_number);
-    if (curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, request_url);
-        // Define write callback (will get called with response data)
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-        // Add user data which we can access in the write callback
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*) request);
-        res = curl_easy_perform(curl);
-        if (res != CURLE_OK) {
-            SDL_Log("ERROR in performing curl request for url %s", request_url);
+    SDL_asprintf(&request_url, "%s/%d/info.0.json", config.base_url, xkcd_number);
+    fetch_submit_json(request_url, NULL, request_priority_offscreen, &xkcd_info_decoder, prefetch_done, (void*) (intptr_t) xkcd_number);
+    SDL_free(request_url);
+}
+
+static void latest_done(const fetch_response_t* response, void* data) {
+    (void) data;
+    latest_job = NULL;
+    next_latest_poll = SDL_GetTicks() + (Uint64) config.poll_interval * 1000;
+    // The latest endpoint answers with the comic itself
+    xkcd_info_t info;
+    bool decoded = response->ok && xkcd_info_decode(response->body, response->size, &info);
+    int latest = decoded ? info.num : 0;
+    // Comics that failed to prefetch after an earlier poll get another chance once the upstream answers again
+    if (response->ok) {
+        int num_missing = num_missing_prefetches;
+        num_missing_prefetches = 0;
+        for (int i = 0; i < num_missing; i++) {
+            if (store_get(missing_prefetches[i]) == NULL) {
+                prefetch(missing_prefetches[i]);
+            }
         }
-        curl_easy_cleanup(curl);
     }
+    int known = store_latest();
+    if (latest <= known) {
+        return;
+    }
+    bool stored = store_get(latest) || store_info(&info, response);
+    if (!stored) {
+        remember_missing_prefetch(latest);
+    }
+    store_set_latest(latest);
+    // Only what was published since the last check, the first check just learns where the archive ends
+    for (int i = known > 0 ? known + 1 : latest; i < latest; i++) {
+        if (store_get(i) == NULL) {
+            prefetch(i);
+        }
+    }
+}
+
+// Asks for the latest comic every config.poll_interval seconds, one small request per interval
+void poll_latest(void) {
+    if (config.poll_interval <= 0 || latest_job || SDL_GetTicks() < next_latest_poll) {
+        return;
+    }
+    char* request_url = NULL;
+    SDL_asprintf(&request_url, "%s/info.0.json", config.base_url);
+    latest_job = fetch_submit(request_url, NULL, request_priority_offscreen, latest_done, NULL);
     SDL_free(request_url);
-    return 0;
 }
 
-xkcd_t create_xkcd(int index, float x, float y, float size_x, float size_y) {
+// Attach the tile to the pending request for its comic, only the first tile asking for a comic hits the network
+void request_xkcd(xkcd_t* xkcd, request_priority priority) {
+    xkcd_request_t* request = find_request(xkcd->xkcd_number);
+    bool pending = request != NULL;
+    if (!pending) {
+        request = add_request(xkcd->xkcd_number);
+        request->priority = priority;
+    }
+    xkcd->next_waiter = request->first_waiter;
+    request->first_waiter = xkcd->index;
+    if (!pending) {
+        make_xkcd_request(request);
+    }
+    else if (store_get(xkcd->xkcd_number)) {
+        // The request is only revalidating a stored comic, no need to wait for it
+        request->cached = true;
+    }
+    else if (priority > request->priority && request->job) {
+        request->priority = priority;
+        fetch_set_priority(request->job, priority);
+    }
+}
+
+// Takes a tile that is still loading off its request, the request is cancelled once nobody waits for it anymore
+void detach_xkcd(xkcd_t* xkcd) {
+    xkcd_request_t* request = find_request(xkcd->xkcd_number);
+    if (request == NULL) {
+        return;
+    }
+    int* link = &request->first_waiter;
+    while (*link >= 0 && *link != xkcd->index) {
+        link = &xkcds[*link].next_waiter;
+    }
+    if (*link < 0) {
+        // Already served, a revalidation that might still be running keeps going for the store
+        return;
+    }
+    *link = xkcd->next_waiter;
+    xkcd->next_waiter = -1;
+    if (request->first_waiter >= 0) {
+        return;
+    }
+    if (request->job) {
+        fetch_cancel(request->job);
+        request->job = NULL;
+    }
+    remove_request(request);
+}
+
+xkcd_t create_xkcd(int index, int xkcd_number, float x, float y, float size_x, float size_y) {
     animation_t animation = create_animation(ANIMATION_DURATION, ease_out_expo, false);
 
     xkcd_t result = {
         .index = index,
+        .xkcd_number = xkcd_number,
+        .next_waiter = -1,
         .loading = true,
+        .failed = false,
+        .has_image = false,
         .animation = animation,
         .destroy = false,
         .destroyed = false,
@@ -183,19 +454,57 @@ xkcd_t create_xkcd(int index, float x, float y, float size_x, float size_y) {
         .font = TTF_OpenFont(FONT_PATH, 16.0f)
     };
 
-    xkcd_requests[index] = (xkcd_request_t) {
-        .index = index,
-        .xkcd_number = 6
-    };
-    SDL_Thread* thread = SDL_CreateThread(make_xkcd_request, "xkcd_request_thread", (void*) &xkcd_requests[index]);
-    if (thread == NULL) {
-        SDL_Log("Failed to create thread");
+    // The tile was just drawn with the mouse, so it is right under the cursor
+    request_xkcd(&result, request_priority_hovered);
+    return result;
+}
+
+// Creates a tile in the slot of a destroyed one if there is any, returns false once all slots are taken
+bool add_xkcd(int xkcd_number, SDL_FRect rect) {
+    int index = 0;
+    while (index < num_xkcds && !xkcds[index].destroyed) {
+        index++;
+    }
+    if (index == MAX_NUM_XKCD) {
+        return false;
+    }
+    if (index < num_xkcds) {
+        TTF_CloseFont(xkcds[index].font);
     }
     else {
-        // Run in background, will automatically be cleaned up once done
-        SDL_DetachThread(thread);
+        num_xkcds++;
+    }
+    xkcds[index] = create_xkcd(index, xkcd_number, rect.x, rect.y, rect.w, rect.h);
+    return true;
+}
+
+// Lays out the newest comics in a grid covering the window, newest first
+void create_newest_wall(void) {
+    int latest = store_latest();
+    if (latest <= 0) {
+        SDL_Log("The latest comic is not known yet");
+        return;
+    }
+    int count = SDL_min(config.newest_count, latest);
+    if (count <= 0) {
+        return;
+    }
+    int columns = (int) ceilf(sqrtf((float) count * window_width / window_height));
+    columns = SDL_clamp(columns, 1, count);
+    int rows = (count + columns - 1) / columns;
+    float cell_w = (float) window_width / columns;
+    float cell_h = (float) window_height / rows;
+    for (int i = 0; i < count; i++) {
+        SDL_FRect rect = {
+            .x = (i % columns) * cell_w + WALL_MARGIN * 0.5f,
+            .y = (i / columns) * cell_h + WALL_MARGIN * 0.5f,
+            .w = cell_w - WALL_MARGIN,
+            .h = cell_h - WALL_MARGIN
+        };
+        if (!add_xkcd(latest - i, rect)) {
+            return;
+        }
     }
-    return result;
 }
 
 xkcd_t* xkcd_at_mouse(void) {
@@ -266,6 +575,40 @@ bool rect_intersects(SDL_FRect a, SDL_FRect b) {
 }
 
 
+request_priority priority_of_xkcd(xkcd_t* xkcd) {
+    // Use the final size, the tile might still be growing
+    SDL_FRect rect = {
+        .x = xkcd->rect.x,
+        .y = xkcd->rect.y,
+        .w = xkcd->size_x,
+        .h = xkcd->size_y
+    };
+    if (inside_rect(mouse_x, mouse_y, rect)) {
+        return request_priority_hovered;
+    }
+    bool onscreen = rect.x < window_width && rect.y < window_height && rect.x + rect.w > 0 && rect.y + rect.h > 0;
+    return onscreen ? request_priority_onscreen : request_priority_offscreen;
+}
+
+// Let the comics the user is looking at jump the fetch queue
+void update_request_priorities(void) {
+    for (int i = 0; i < MAX_NUM_XKCD; i++) {
+        xkcd_request_t* request = &xkcd_requests[i];
+        if (!request->in_use || request->job == NULL) {
+            continue;
+        }
+        // A request is as important as the most important tile waiting on it
+        request_priority priority = request_priority_offscreen;
+        for (int waiter = request->first_waiter; waiter >= 0; waiter = xkcds[waiter].next_waiter) {
+            priority = SDL_max(priority, priority_of_xkcd(&xkcds[waiter]));
+        }
+        if (priority != request->priority) {
+            request->priority = priority;
+            fetch_set_priority(request->job, priority);
+        }
+    }
+}
+
 bool initialize() {
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         SDL_Log("Could not initialize SDL: '%s'\n", SDL_GetError());
@@ -290,9 +633,23 @@ bool initialize() {
         SDL_Log("Could not create text engine: '%s'\n", SDL_GetError());
         return false;
     }
+    stats_font = TTF_OpenFont(FONT_PATH, STATS_FONT_SIZE);
+    if (stats_font == NULL) {
+        SDL_Log("Could not open font: '%s'\n", SDL_GetError());
+        return false;
+    }
 
     // Initialize curl
     curl_global_init(CURL_GLOBAL_ALL);
+    if (!fetch_init()) {
+        return false;
+    }
+    if (!store_open()) {
+        return false;
+    }
+    if (!images_init(renderer)) {
+        return false;
+    }
 
     start_time = SDL_GetTicks();
     return true;
@@ -312,12 +669,8 @@ void process(void) {
                 break;
             case SDL_EVENT_MOUSE_BUTTON_UP:
                 mouse_down = false;
-                // Create new xkc
-                if (num_xkcds < MAX_NUM_XKCD) {
-                    SDL_FRect rect = rect_from_mouse();
-                    xkcds[num_xkcds] = create_xkcd(num_xkcds, rect.x, rect.y, rect.w, rect.h);
-                    num_xkcds++;
-                }
+                // Create new xkcd
+                add_xkcd(6, rect_from_mouse());
                 break;
             case SDL_EVENT_KEY_DOWN:
                 if (e.key.key == SDLK_D) {
@@ -329,6 +682,20 @@ void process(void) {
                     animation_t animation = create_animation(ANIMATION_DURATION, ease_in_sine, true);
                     xkcd_to_delete->animation = animation;
                     xkcd_to_delete->destroy = true;
+                    // Nothing may write into the tile anymore once its slot gets reused
+                    detach_xkcd(xkcd_to_delete);
+                    break;
+                }
+                if (e.key.key == SDLK_T) {
+                    fetch_log_timings();
+                    break;
+                }
+                if (e.key.key == SDLK_N) {
+                    create_newest_wall();
+                    break;
+                }
+                if (e.key.key == SDLK_S) {
+                    show_stats = !show_stats;
                     break;
                 }
                 if (e.key.key == SDLK_ESCAPE) {
@@ -343,6 +710,12 @@ void update_xkcd(xkcd_t* xkcd) {
     if (xkcd->destroyed) {
         return;
     }
+    // Let go of the image as soon as the tile is on its way out, so a download still in flight is cancelled.
+    // has_image is cleared with it, which keeps the release from happening twice
+    if (xkcd->destroy && xkcd->has_image) {
+        images_release(xkcd->xkcd_number);
+        xkcd->has_image = false;
+    }
     update_animation(&xkcd->animation);
     xkcd->destroyed = xkcd->destroy && xkcd->animation.done;
     float animation_value = xkcd->animation.value;
@@ -350,6 +723,14 @@ void update_xkcd(xkcd_t* xkcd) {
     xkcd->rect.h = animation_value * xkcd->size_y;
     xkcd->font_size = ceilf(animation_value * 0.2f * xkcd->size_y);
     TTF_SetFontSize(xkcd->font, xkcd->font_size);
+    if (!xkcd->loading && !xkcd->destroy && !xkcd->has_image) {
+        // Once the metadata is there the image can follow, fetched and decoded in the background
+        const store_record_t* record = store_get(xkcd->xkcd_number);
+        if (record && record->img.size > 0) {
+            images_acquire(xkcd->xkcd_number, store_string(record->img), priority_of_xkcd(xkcd));
+            xkcd->has_image = true;
+        }
+    }
 }
 
 
@@ -359,32 +740,57 @@ void update(void) {
         SDL_Delay(time_to_wait);
     }
     seconds_passed += FRAME_TARGET_TIME_SECONDS;
+    fetch_dispatch();
+    dispatch_cached_requests();
+    poll_latest();
+    images_update();
     xkcd_indication_rect = rect_from_mouse();
     for (int i = 0; i < num_xkcds; i++) {
         update_xkcd(&xkcds[i]);
     }
+    update_request_priorities();
     start_time = SDL_GetTicks();
 }
 
-void render_xkcd(xkcd_t* xkcd) {
+// Background and image of a tile, the images only reach the renderer with images_flush
+void render_xkcd_content(xkcd_t* xkcd) {
     if (xkcd->destroyed) {
         return;
     }
-    const char* message = xkcd->loading ? "Loading" : xkcd->message;
     SDL_SetRenderDrawColor(renderer, 0x18, 0x18, 0x18, 0xff);
+    SDL_RenderFillRect(renderer, &xkcd->rect);
+    if (xkcd->has_image) {
+        SDL_FRect bounds = {
+            .x = xkcd->rect.x + IMAGE_PADDING,
+            .y = xkcd->rect.y + IMAGE_PADDING,
+            .w = SDL_max(xkcd->rect.w - 2.0f * IMAGE_PADDING, 0.0f),
+            .h = SDL_max(xkcd->rect.h - 2.0f * IMAGE_PADDING, 0.0f)
+        };
+        images_draw(xkcd->xkcd_number, bounds);
+    }
+}
+
+void render_xkcd(xkcd_t* xkcd) {
+    if (xkcd->destroyed) {
+        return;
+    }
+    // Read straight from the mapped store, there is no copy of the title in the tile
+    const store_record_t* record = xkcd->loading ? NULL : store_get(xkcd->xkcd_number);
+    const char* message = record ? store_string(record->title) : (xkcd->failed ? "Failed" : "Loading");
     bool animation_done = xkcd->animation.done;
     bool draw_border = !xkcd->destroy || (xkcd->destroy && !animation_done);
-    SDL_RenderFillRect(renderer, &xkcd->rect);
     bool is_hovering = inside_rect(mouse_x, mouse_y, xkcd->rect);
     
-    // Render text
-    TTF_Text* text = TTF_CreateText(text_engine, xkcd->font, message, 0);
-    SDL_SetRenderDrawColor(renderer, 0xe4, 0xe4, 0xef, 0xff);
-    int text_w;
-    int text_h;
-    TTF_GetTextSize(text, &text_w, &text_h);
-    TTF_DrawRendererText(text, xkcd->rect.x + (xkcd->rect.w - text_w) * 0.5, xkcd->rect.y + (xkcd->rect.h - text_h) * 0.5f);
-    TTF_DestroyText(text);
+    if (!xkcd->has_image || !images_ready(xkcd->xkcd_number)) {
+        // Render text
+        TTF_Text* text = TTF_CreateText(text_engine, xkcd->font, message, 0);
+        SDL_SetRenderDrawColor(renderer, 0xe4, 0xe4, 0xef, 0xff);
+        int text_w;
+        int text_h;
+        TTF_GetTextSize(text, &text_w, &text_h);
+        TTF_DrawRendererText(text, xkcd->rect.x + (xkcd->rect.w - text_w) * 0.5, xkcd->rect.y + (xkcd->rect.h - text_h) * 0.5f);
+        TTF_DestroyText(text);
+    }
     
     // Draw border
     if (draw_border) {
@@ -394,6 +800,9 @@ void render_xkcd(xkcd_t* xkcd) {
         else if (xkcd->loading) {
             SDL_SetRenderDrawColor(renderer, 0xf4, 0x38, 0x41, 0xff);
         }
+        else if (xkcd->failed) {
+            SDL_SetRenderDrawColor(renderer, 0x80, 0x80, 0x80, 0xff);
+        }
         else {
             SDL_SetRenderDrawColor(renderer, 0xff, 0xdd, 0x33, 0xff);
         }
@@ -402,6 +811,37 @@ void render_xkcd(xkcd_t* xkcd) {
 
 }
 
+// Overlay with the state of the request rate limiter
+void render_stats(void) {
+    fetch_stats_t stats;
+    fetch_get_stats(&stats);
+    char message[256];
+    SDL_snprintf(message, sizeof(message), "limit %d   active %d   queued %d   throttled %d   retried %d   hedged %d",
+        stats.limit, stats.active, stats.queued, stats.throttled, stats.retried, stats.hedged);
+    TTF_Text* text = TTF_CreateText(text_engine, stats_font, message, 0);
+    int text_w;
+    int text_h;
+    TTF_GetTextSize(text, &text_w, &text_h);
+    SDL_FRect background = { .x = 0.0f, .y = 0.0f, .w = text_w + 16.0f, .h = text_h + 8.0f };
+    SDL_SetRenderDrawColor(renderer, 0x18, 0x18, 0x18, 0xff);
+    SDL_RenderFillRect(renderer, &background);
+    TTF_DrawRendererText(text, 8.0f, 4.0f);
+    TTF_DestroyText(text);
+}
+
+// Whether the tile overlaps one of the tiles from first up to end
+bool overlaps_layer(const xkcd_t* xkcd, int first, int end) {
+    if (xkcd->destroyed) {
+        return false;
+    }
+    for (int i = first; i < end; i++) {
+        if (!xkcds[i].destroyed && SDL_HasRectIntersectionFloat(&xkcd->rect, &xkcds[i].rect)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void render(void) {
     SDL_SetRenderDrawColor(renderer, 0x18, 0x18, 0x18, 0xff);
     SDL_RenderClear(renderer);
@@ -412,17 +852,41 @@ void render(void) {
         SDL_RenderRect(renderer, &xkcd_indication_rect);
     }
 
-    for (int i = 0; i < num_xkcds; i++) {
-        render_xkcd(&xkcds[i]);
+    // Tiles go in layers of tiles that do not overlap. A layer is drawn in two passes, contents then text and
+    // borders, so that all of its images draw with one call per atlas page. A wall is a single layer, and
+    // a tile dragged over earlier ones starts a new layer so it still ends up on top of them
+    int first = 0;
+    while (first < num_xkcds) {
+        int end = first + 1;
+        while (end < num_xkcds && !overlaps_layer(&xkcds[end], first, end)) {
+            end++;
+        }
+        for (int i = first; i < end; i++) {
+            render_xkcd_content(&xkcds[i]);
+        }
+        images_flush();
+        for (int i = first; i < end; i++) {
+            render_xkcd(&xkcds[i]);
+        }
+        first = end;
+    }
+    if (show_stats) {
+        render_stats();
     }
     SDL_RenderPresent(renderer);
 }
 
 void destroy(void) {
+    fetch_log_timings();
+    fetch_shutdown();
     curl_global_cleanup();
+    images_shutdown();
+    xkcd_info_shutdown();
+    store_close();
     for (int i = 0; i < num_xkcds; i++) {
         TTF_CloseFont(xkcds[i].font);
     }
+    TTF_CloseFont(stats_font);
     TTF_DestroyRendererTextEngine(text_engine);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
@@ -430,7 +894,123 @@ void destroy(void) {
     SDL_Quit();
 }
 
-int main(void) {
+static void sync_image_done(const fetch_response_t* response, void* data) {
+    int xkcd_number = (int) (intptr_t) data;
+    sync_state.pending--;
+    if (response->ok && store_put_image(xkcd_number, response->body, response->size)) {
+        sync_state.images++;
+    }
+    else {
+        SDL_Log("ERROR in syncing image of xkcd %d", xkcd_number);
+        sync_state.failed++;
+    }
+}
+
+void sync_image(int xkcd_number) {
+    const store_record_t* record = store_get(xkcd_number);
+    if (record == NULL || record->img.size == 0 || record->image.size > 0) {
+        return;
+    }
+    sync_state.pending++;
+    fetch_submit(store_string(record->img), NULL, 0, sync_image_done, (void*) (intptr_t) xkcd_number);
+}
+
+static void sync_comic_done(const fetch_response_t* response, void* data) {
+    int xkcd_number = (int) (intptr_t) data;
+    sync_state.pending--;
+    if (response->ok && store_response(xkcd_number, response)) {
+        sync_state.comics++;
+        if (config.sync_images) {
+            sync_image(xkcd_number);
+        }
+    }
+    // There is no comic 404, every other gap is an error
+    else if (response->status != 404) {
+        SDL_Log("ERROR in syncing xkcd %d", xkcd_number);
+        sync_state.failed++;
+    }
+}
+
+static void sync_latest_done(const fetch_response_t* response, void* data) {
+    (void) data;
+    sync_state.pending--;
+    const xkcd_info_t* info = response->ok ? xkcd_info_decoded(response->decoded) : NULL;
+    if (info) {
+        sync_state.latest = info->num;
+    }
+    if (sync_state.latest <= 0) {
+        SDL_Log("ERROR in fetching the latest xkcd");
+        return;
+    }
+    store_set_latest(sync_state.latest);
+    if (store_get(sync_state.latest) == NULL && store_info(info, response)) {
+        sync_state.comics++;
+    }
+}
+
+void wait_for_sync(Uint64 start) {
+    Uint64 last_progress = SDL_GetTicks();
+    while (sync_state.pending > 0) {
+        SDL_Delay(SYNC_POLL_MS);
+        fetch_dispatch();
+        if (SDL_GetTicks() - last_progress >= SYNC_PROGRESS_MS) {
+            fetch_stats_t stats;
+            fetch_get_stats(&stats);
+            SDL_Log("Syncing: %d comics and %d images stored, %d pending, %d transfers at once (%.1fs)",
+                sync_state.comics, sync_state.images, sync_state.pending, stats.limit, (SDL_GetTicks() - start) * 0.001f);
+            last_progress = SDL_GetTicks();
+        }
+    }
+}
+
+// Headless mirror of the whole archive into the store. Comics that are already stored are skipped, so
+// later syncs only download what was published since
+bool run_sync(void) {
+    curl_global_init(CURL_GLOBAL_ALL);
+    bool ok = fetch_init() && store_open();
+    if (ok) {
+        Uint64 start = SDL_GetTicks();
+        char* request_url = NULL;
+        SDL_asprintf(&request_url, "%s/info.0.json", config.base_url);
+        sync_state.pending++;
+        fetch_submit_json(request_url, NULL, 0, &xkcd_info_decoder, sync_latest_done, NULL);
+        SDL_free(request_url);
+        wait_for_sync(start);
+        ok = sync_state.latest > 0;
+
+        // Everything that is missing goes out at once, the rate limiter decides how fast
+        for (int i = 1; ok && i <= sync_state.latest; i++) {
+            if (store_get(i)) {
+                if (config.sync_images) {
+                    sync_image(i);
+                }
+                continue;
+            }
+            SDL_asprintf(&request_url, "%s/%d/info.0.json", config.base_url, i);
+            sync_state.pending++;
+            fetch_submit_json(request_url, NULL, 0, &xkcd_info_decoder, sync_comic_done, (void*) (intptr_t) i);
+            SDL_free(request_url);
+        }
+        wait_for_sync(start);
+        SDL_Log("Synced %d comics and %d images up to xkcd %d in %.1fs, %d failed",
+            sync_state.comics, sync_state.images, sync_state.latest, (SDL_GetTicks() - start) * 0.001f, sync_state.failed);
+        ok = ok && sync_state.failed == 0;
+    }
+    fetch_log_timings();
+    fetch_shutdown();
+    curl_global_cleanup();
+    xkcd_info_shutdown();
+    store_close();
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    if (!config_parse(argc, argv)) {
+        return 1;
+    }
+    if (config.sync) {
+        return run_sync() ? 0 : 1;
+    }
     running = initialize();
 
     while (running) {
@@ -0,0 +1,330 @@
+// mmap, ftruncate and friends are POSIX, not C99
+#define _POSIX_C_SOURCE 200809L
+
+#include <SDL3/SDL.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "store.h"
+#include "config.h"
+
+#define STORE_ORGANIZATION "yhutter"
+#define STORE_APPLICATION "xkcd-viewer"
+#define STORE_RECORDS_FILE "xkcd.records"
+#define STORE_HEAP_FILE "xkcd.heap"
+#define STORE_MAGIC "XKCDSTOR"
+// Bump whenever store_record_t changes, old stores are then discarded and rebuilt
+#define STORE_VERSION 4
+#define STORE_MIN_RECORDS 4096
+#define STORE_MIN_HEAP (1024 * 1024)
+
+typedef struct {
+    char magic[8];
+    Uint32 version;
+    Uint32 record_size;
+    Uint64 capacity; // Number of record slots following the header
+    Uint64 heap_used; // Bytes of the heap file that hold strings, the rest is preallocated space
+    Sint32 latest; // Number of the newest comic the server told us about, 0 if unknown
+    Uint32 reserved;
+} store_header_t;
+
+typedef struct {
+    int fd;
+    void* data;
+    size_t size;
+} store_file_t;
+
+static store_file_t records = { .fd = -1 };
+static store_file_t heap = { .fd = -1 };
+
+static store_header_t* header(void) {
+    return (store_header_t*) records.data;
+}
+
+static store_record_t* record_at(Uint64 index) {
+    return (store_record_t*) ((char*) records.data + sizeof(store_header_t)) + index;
+}
+
+static bool map_file(store_file_t* file, size_t size) {
+    if (file->data) {
+        munmap(file->data, file->size);
+        file->data = NULL;
+    }
+    if (ftruncate(file->fd, (off_t) size) != 0) {
+        SDL_Log("Could not resize store file");
+        return false;
+    }
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (data == MAP_FAILED) {
+        SDL_Log("Could not map store file");
+        return false;
+    }
+    file->data = data;
+    file->size = size;
+    return true;
+}
+
+static bool open_file(store_file_t* file, const char* dir, const char* name) {
+    char* path = NULL;
+    SDL_asprintf(&path, "%s%s", dir, name);
+    file->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (file->fd < 0) {
+        SDL_Log("Could not open store file %s", path);
+        SDL_free(path);
+        return false;
+    }
+    SDL_free(path);
+    return true;
+}
+
+static bool file_size(const store_file_t* file, size_t* size) {
+    struct stat info;
+    if (fstat(file->fd, &info) != 0) {
+        return false;
+    }
+    *size = (size_t) info.st_size;
+    return true;
+}
+
+// Two processes appending to the same pack would overwrite each other's strings and records, and one of
+// them resizing the files to its own idea of their size could cut off what the other wrote. The lock is
+// released when the file is closed, even if the process dies
+static bool lock_store(const char* dir) {
+    if (flock(records.fd, LOCK_EX | LOCK_NB) == 0) {
+        return true;
+    }
+    if (errno == EWOULDBLOCK) {
+        SDL_Log("The cache in %s is in use by another xkcd_viewer, close it or pass a different --cache-dir", dir);
+    }
+    else {
+        SDL_Log("Could not lock the cache in %s", dir);
+    }
+    return false;
+}
+
+static bool reset_store(void) {
+    if (!map_file(&records, sizeof(store_header_t) + sizeof(store_record_t) * STORE_MIN_RECORDS)) {
+        return false;
+    }
+    if (!map_file(&heap, STORE_MIN_HEAP)) {
+        return false;
+    }
+    // ftruncate zero fills, which marks every record as not present
+    SDL_memset(records.data, 0, records.size);
+    store_header_t* store_header = header();
+    SDL_memcpy(store_header->magic, STORE_MAGIC, sizeof(store_header->magic));
+    store_header->version = STORE_VERSION;
+    store_header->record_size = sizeof(store_record_t);
+    store_header->capacity = STORE_MIN_RECORDS;
+    // Offset 0 is an empty string, so zeroed store_string_t values resolve to ""
+    ((char*) heap.data)[0] = '\0';
+    store_header->heap_used = 1;
+    return true;
+}
+
+static char* store_dir(void) {
+    char* dir = NULL;
+    if (config.cache_dir && config.cache_dir[0] != '\0') {
+        size_t length = SDL_strlen(config.cache_dir);
+        bool has_separator = config.cache_dir[length - 1] == '/' || config.cache_dir[length - 1] == '\\';
+        SDL_asprintf(&dir, "%s%s", config.cache_dir, has_separator ? "" : "/");
+    }
+    else {
+        char* pref_path = SDL_GetPrefPath(STORE_ORGANIZATION, STORE_APPLICATION);
+        if (pref_path == NULL) {
+            SDL_Log("Could not get pref path: '%s'\n", SDL_GetError());
+            return NULL;
+        }
+        SDL_asprintf(&dir, "%scache/", pref_path);
+        SDL_free(pref_path);
+    }
+    return dir;
+}
+
+bool store_open(void) {
+    char* dir = store_dir();
+    if (dir == NULL) {
+        return false;
+    }
+    if (!SDL_CreateDirectory(dir)) {
+        SDL_Log("Could not create cache directory %s: '%s'\n", dir, SDL_GetError());
+        SDL_free(dir);
+        return false;
+    }
+    size_t records_size = 0;
+    size_t heap_size = 0;
+    // The sizes are only read once nobody else can change them anymore
+    bool opened = open_file(&records, dir, STORE_RECORDS_FILE) && lock_store(dir) &&
+        open_file(&heap, dir, STORE_HEAP_FILE) && file_size(&records, &records_size) && file_size(&heap, &heap_size);
+    SDL_free(dir);
+    if (!opened) {
+        return false;
+    }
+    if (records_size < sizeof(store_header_t) || heap_size == 0) {
+        return reset_store();
+    }
+    if (!map_file(&records, records_size) || !map_file(&heap, heap_size)) {
+        return false;
+    }
+    store_header_t* store_header = header();
+    bool valid = SDL_memcmp(store_header->magic, STORE_MAGIC, sizeof(store_header->magic)) == 0 &&
+        store_header->version == STORE_VERSION &&
+        store_header->record_size == sizeof(store_record_t) &&
+        sizeof(store_header_t) + store_header->capacity * sizeof(store_record_t) <= records_size &&
+        store_header->heap_used <= heap_size;
+    if (!valid) {
+        SDL_Log("Discarding cache store with an incompatible format");
+        return reset_store();
+    }
+    return true;
+}
+
+void store_close(void) {
+    store_file_t* files[] = { &records, &heap };
+    for (size_t i = 0; i < SDL_arraysize(files); i++) {
+        store_file_t* file = files[i];
+        if (file->data) {
+            msync(file->data, file->size, MS_SYNC);
+            munmap(file->data, file->size);
+            file->data = NULL;
+        }
+        if (file->fd >= 0) {
+            close(file->fd);
+            file->fd = -1;
+        }
+    }
+}
+
+const store_record_t* store_get(int xkcd_number) {
+    if (records.data == NULL || xkcd_number < 0 || (Uint64) xkcd_number >= header()->capacity) {
+        return NULL;
+    }
+    const store_record_t* record = record_at((Uint64) xkcd_number);
+    return (record->flags & STORE_RECORD_PRESENT) ? record : NULL;
+}
+
+const char* store_string(store_string_t string) {
+    return (const char*) heap.data + string.offset;
+}
+
+static bool append_string(xkcd_string_t string, store_string_t* result) {
+    if (string.size == 0) {
+        *result = (store_string_t) {0};
+        return true;
+    }
+    Uint64 offset = header()->heap_used;
+    Uint64 needed = offset + string.size + 1;
+    if (needed > heap.size) {
+        size_t size = heap.size * 2;
+        while (size < needed) {
+            size *= 2;
+        }
+        if (!map_file(&heap, size)) {
+            return false;
+        }
+    }
+    char* destination = (char*) heap.data + offset;
+    SDL_memcpy(destination, string.data, string.size);
+    destination[string.size] = '\0';
+    header()->heap_used = needed;
+    *result = (store_string_t) {
+        .offset = offset,
+        .size = (Uint32) string.size
+    };
+    return true;
+}
+
+static bool reserve_records(Uint64 index) {
+    Uint64 capacity = header()->capacity;
+    if (index < capacity) {
+        return true;
+    }
+    while (capacity <= index) {
+        capacity *= 2;
+    }
+    if (!map_file(&records, sizeof(store_header_t) + sizeof(store_record_t) * capacity)) {
+        return false;
+    }
+    header()->capacity = capacity;
+    return true;
+}
+
+static SDL_Time now(void) {
+    SDL_Time time = 0;
+    SDL_GetCurrentTime(&time);
+    return time;
+}
+
+bool store_put(const xkcd_info_t* info, const store_validators_t* validators) {
+    if (records.data == NULL || info->num < 0 || !reserve_records((Uint64) info->num)) {
+        return false;
+    }
+    store_record_t record = {
+        .flags = STORE_RECORD_PRESENT,
+        .num = info->num,
+        .year = info->year,
+        .month = info->month,
+        .day = info->day,
+        .fetched_at = now()
+    };
+    store_validators_t no_validators = {0};
+    if (validators == NULL) {
+        validators = &no_validators;
+    }
+    bool ok = append_string(info->title, &record.title) &&
+        append_string(info->safe_title, &record.safe_title) &&
+        append_string(info->alt, &record.alt) &&
+        append_string(info->img, &record.img) &&
+        append_string(info->transcript, &record.transcript) &&
+        append_string(info->link, &record.link) &&
+        append_string(info->news, &record.news) &&
+        append_string(validators->etag, &record.etag) &&
+        append_string(validators->last_modified, &record.last_modified);
+    if (!ok) {
+        return false;
+    }
+    const store_record_t* previous = store_get(info->num);
+    if (previous && previous->img.size == record.img.size && previous->image.size > 0 &&
+        SDL_memcmp(store_string(previous->img), store_string(record.img), record.img.size) == 0) {
+        record.image = previous->image;
+    }
+    // Written last and in one go, a record is either missing or points at complete strings
+    *record_at((Uint64) info->num) = record;
+    return true;
+}
+
+bool store_put_image(int xkcd_number, const void* data, size_t size) {
+    if (store_get(xkcd_number) == NULL || size > SDL_MAX_UINT32) {
+        return false;
+    }
+    store_string_t image;
+    if (!append_string((xkcd_string_t) { (const char*) data, size }, &image)) {
+        return false;
+    }
+    // The heap might have been remapped, but the record file was not
+    record_at((Uint64) xkcd_number)->image = image;
+    return true;
+}
+
+int store_latest(void) {
+    return records.data ? header()->latest : 0;
+}
+
+void store_set_latest(int xkcd_number) {
+    if (records.data && xkcd_number > header()->latest) {
+        header()->latest = xkcd_number;
+    }
+}
+
+void store_touch(int xkcd_number) {
+    if (store_get(xkcd_number)) {
+        record_at((Uint64) xkcd_number)->fetched_at = now();
+    }
+}
+
+bool store_is_fresh(const store_record_t* record, int max_age_seconds) {
+    return now() - record->fetched_at < (SDL_Time) SDL_SECONDS_TO_NS(max_age_seconds);
+}
@@ -0,0 +1,79 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include "xkcd_info.h"
+
+// Offset of a null terminated string (or a blob) in the heap
+typedef struct {
+    Uint64 offset;
+    Uint32 size;
+    Uint32 reserved;
+} store_string_t;
+
+#define STORE_RECORD_PRESENT 0x1u
+
+// Fixed size record, the record of comic n lives at index n so a lookup is a pointer calculation
+typedef struct {
+    Uint32 flags;
+    Sint32 num;
+    Sint32 year;
+    Sint32 month;
+    Sint32 day;
+    Uint32 reserved;
+    SDL_Time fetched_at; // When the record was last downloaded or revalidated
+    store_string_t title;
+    store_string_t safe_title;
+    store_string_t alt;
+    store_string_t img;
+    store_string_t transcript;
+    store_string_t link;
+    store_string_t news;
+    // Validators from the response, sent back as If-None-Match / If-Modified-Since when revalidating
+    store_string_t etag;
+    store_string_t last_modified;
+    // Encoded bytes of the image img points to, empty unless a sync mirrored it
+    store_string_t image;
+} store_record_t;
+
+typedef struct {
+    xkcd_string_t etag;
+    xkcd_string_t last_modified;
+} store_validators_t;
+
+// The two files are an append only pack: the heap only ever grows and a record is written last, once
+// everything it points to is in place.
+// Maps the record file and the string heap of the store in the cache directory (config.cache_dir or the
+// user's pref path), both are created if they don't exist yet
+bool store_open(void);
+
+void store_close(void);
+
+// Returns NULL if the comic is not in the store. The record and the strings it points to are only valid
+// until the next store_put, which might grow and remap the files
+const store_record_t* store_get(int xkcd_number);
+
+// Resolves a string of a record to a pointer into the mapped heap
+const char* store_string(store_string_t string);
+
+// Appends the strings of the comic to the heap and writes its record, validators is optional.
+// A stored image is kept as long as the image url did not change
+bool store_put(const xkcd_info_t* info, const store_validators_t* validators);
+
+// Appends the encoded image of a stored comic to the heap
+bool store_put_image(int xkcd_number, const void* data, size_t size);
+
+// Number of the newest comic known, 0 until the latest comic was fetched once
+int store_latest(void);
+
+// Remembers a newer latest comic, older numbers are ignored
+void store_set_latest(int xkcd_number);
+
+// The server confirmed the stored comic is still current, restart its freshness period
+void store_touch(int xkcd_number);
+
+// Whether the comic was fetched or revalidated less than max_age_seconds ago
+bool store_is_fresh(const store_record_t* record, int max_age_seconds);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include "fetch.h"
+
+// Growable buffer the response chunks get appended to
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} fetch_buffer_t;
+
+struct fetch_job_s {
+    char* url;
+    char** headers; // NULL terminated list of extra request headers
+    fetch_buffer_t body; // Stays empty while parser is set
+    const fetch_decoder_t* decoder; // Submitted with fetch_submit_json
+    struct fetch_parser_s* parser; // Decodes the body as it arrives, set once the transfer starts
+    char* etag;
+    char* last_modified;
+    long status;
+    bool ok;
+    bool timed_out; // Set by the transport when it gave up on a connection or a stalled transfer
+    fetch_done_func done;
+    void* data;
+    void* transport_data; // Owned by the transport while the transfer is running
+    // Higher priorities start first, jobs with the same priority start in submission order
+    SDL_AtomicInt priority;
+    Uint64 sequence;
+    // Set by fetch_cancel, the network thread drops the job the next time it looks at it
+    SDL_AtomicInt cancelled;
+    Uint64 started_at; // Tick the transfer was handed to the transport
+    Uint64 phase_us[fetch_phase_count]; // Filled in by the transport, 0 for phases that did not happen
+    int attempt; // Number of retries so far
+    Uint64 due; // Tick a retry may start at
+    bool running; // In the list of running transfers
+    // A hedged job runs a second copy of itself once it takes unusually long, whichever answers first wins
+    bool hedged;
+    struct fetch_job_s* hedge; // The copy, while it exists
+    struct fetch_job_s* hedge_of; // Set on the copy, points back at the job it was made for
+    struct fetch_job_s* next;
+    // Links in the list of running transfers
+    struct fetch_job_s* active_prev;
+    struct fetch_job_s* active_next;
+};
+
+// A backend that performs the actual transfers. Everything except wakeup is called on the network thread
+typedef struct {
+    const char* name;
+    bool (*init)(void);
+    // Start the transfer, the transport calls fetch_complete once it is done (which may be right away)
+    void (*start)(fetch_job_t* job);
+    // Make progress on the running transfers, blocks for at most timeout_ms or until wakeup is called
+    void (*poll)(int timeout_ms);
+    // Interrupts poll, can be called from any thread
+    void (*wakeup)(void);
+    // Drops whatever the transport holds for a transfer that has not completed
+    void (*abort)(fetch_job_t* job);
+    void (*shutdown)(void);
+} fetch_transport_t;
+
+// Talks to config.base_url (or whatever host the url names) over HTTP
+extern const fetch_transport_t transport_curl;
+// Serves canned responses from config.canned_dir, the url path is the file path
+extern const fetch_transport_t transport_file;
+// Generates comics in process with config.fake_latency_ms latency and config.fake_failure_rate failures
+extern const fetch_transport_t transport_fake;
+
+// Helpers for transports, only to be called on the network thread
+bool fetch_reserve_body(fetch_job_t* job, size_t capacity);
+bool fetch_append_body(fetch_job_t* job, const void* data, size_t size);
+void fetch_complete(fetch_job_t* job, bool ok, long status);
+
+#endif
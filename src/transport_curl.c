@@ -0,0 +1,262 @@
+#include <SDL3/SDL.h>
+#include <curl/curl.h>
+#include "config.h"
+#include "transport.h"
+
+// What the transport keeps per running transfer (fetch_job_t::transport_data)
+typedef struct {
+    CURL* curl;
+    struct curl_slist* headers; // Has to outlive the transfer
+    bool sized; // The first chunk arrived and the body was reserved from the content length, if there was one
+} curl_transfer_t;
+
+static CURLM* multi = NULL;
+static CURLSH* share = NULL;
+// One mutex per kind of data the share handle hands out
+static SDL_Mutex* share_mutexes[CURL_LOCK_DATA_LAST] = {0};
+
+static void share_lock(CURL* curl, curl_lock_data data, curl_lock_access access, void* user) {
+    (void) curl;
+    (void) access;
+    (void) user;
+    SDL_LockMutex(share_mutexes[data]);
+}
+
+static void share_unlock(CURL* curl, curl_lock_data data, void* user) {
+    (void) curl;
+    (void) user;
+    SDL_UnlockMutex(share_mutexes[data]);
+}
+
+static bool create_share(void) {
+    share = curl_share_init();
+    if (share == NULL) {
+        SDL_Log("Could not create curl share handle");
+        return false;
+    }
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        share_mutexes[i] = SDL_CreateMutex();
+    }
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    // Resolve xkcd.com once, do the TLS handshake once and keep the connection around for every request
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    return true;
+}
+
+static void destroy_share(void) {
+    if (share) {
+        curl_share_cleanup(share);
+        share = NULL;
+    }
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        SDL_DestroyMutex(share_mutexes[i]);
+        share_mutexes[i] = NULL;
+    }
+}
+
+static size_t write_callback(void* contents, size_t size, size_t bytes, void* data) {
+    fetch_job_t* job = (fetch_job_t*) data;
+    size_t real_size = size * bytes;
+    curl_transfer_t* transfer = (curl_transfer_t*) job->transport_data;
+    if (!transfer->sized) {
+        // First chunk, allocate the whole body up front if the server told us how big it is. A streamed
+        // body never gets data, so this can not go by the body being empty
+        transfer->sized = true;
+        curl_off_t content_length = -1;
+        curl_easy_getinfo(transfer->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length);
+        if (content_length > 0 && !fetch_reserve_body(job, (size_t) content_length + 1)) {
+            return CURL_WRITEFUNC_ERROR;
+        }
+    }
+    if (!fetch_append_body(job, contents, real_size)) {
+        return CURL_WRITEFUNC_ERROR;
+    }
+    return real_size;
+}
+
+// Returns a copy of the header value if the line is the header with the given name
+static char* header_value(const char* line, size_t size, const char* name) {
+    size_t name_length = SDL_strlen(name);
+    if (size <= name_length || line[name_length] != ':' || SDL_strncasecmp(line, name, name_length) != 0) {
+        return NULL;
+    }
+    size_t start = name_length + 1;
+    while (start < size && (line[start] == ' ' || line[start] == '\t')) {
+        start++;
+    }
+    size_t end = size;
+    while (end > start && (line[end - 1] == '\r' || line[end - 1] == '\n' || line[end - 1] == ' ')) {
+        end--;
+    }
+    char* value = (char*) SDL_malloc(end - start + 1);
+    SDL_memcpy(value, line + start, end - start);
+    value[end - start] = '\0';
+    return value;
+}
+
+static size_t header_callback(char* line, size_t size, size_t count, void* data) {
+    fetch_job_t* job = (fetch_job_t*) data;
+    size_t real_size = size * count;
+    // A new status line means a new response (e.g. after a redirect), forget what the previous one sent
+    if (real_size > 5 && SDL_strncmp(line, "HTTP/", 5) == 0) {
+        SDL_free(job->etag);
+        SDL_free(job->last_modified);
+        job->etag = NULL;
+        job->last_modified = NULL;
+        return real_size;
+    }
+    char* value = header_value(line, real_size, "ETag");
+    if (value) {
+        SDL_free(job->etag);
+        job->etag = value;
+    }
+    value = header_value(line, real_size, "Last-Modified");
+    if (value) {
+        SDL_free(job->last_modified);
+        job->last_modified = value;
+    }
+    return real_size;
+}
+
+static bool curl_transport_init(void) {
+    multi = curl_multi_init();
+    if (multi == NULL) {
+        SDL_Log("Could not create curl multi handle");
+        return false;
+    }
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    return create_share();
+}
+
+static void curl_transport_start(fetch_job_t* job) {
+    CURL* curl = curl_easy_init();
+    if (curl == NULL) {
+        SDL_Log("ERROR in creating curl handle for url %s", job->url);
+        fetch_complete(job, false, 0);
+        return;
+    }
+    curl_transfer_t* transfer = (curl_transfer_t*) SDL_calloc(1, sizeof(curl_transfer_t));
+    transfer->curl = curl;
+    job->transport_data = transfer;
+    curl_easy_setopt(curl, CURLOPT_URL, job->url);
+    // Error pages are not comics, treat HTTP errors as failed transfers
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    // Prefer HTTP/2 and wait for an existing connection to multiplex on instead of opening a new one
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long) CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    // A dead host or a transfer that stopped sending fails as a timeout, which is retried
+    if (config.connect_timeout_ms > 0) {
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long) config.connect_timeout_ms);
+    }
+    if (config.stall_timeout_ms > 0) {
+        // curl measures the speed over whole seconds
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long) ((config.stall_timeout_ms + 999) / 1000));
+    }
+    // Define write callback (will get called with response data)
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    // Add user data which we can access in the write callback
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*) job);
+    // Collect the validators so the response can be revalidated later
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void*) job);
+    for (int i = 0; job->headers[i]; i++) {
+        transfer->headers = curl_slist_append(transfer->headers, job->headers[i]);
+    }
+    if (transfer->headers) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->headers);
+    }
+    // Lets us find the job again once curl reports the transfer as done
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (void*) job);
+    curl_multi_add_handle(multi, curl);
+}
+
+static void release(curl_transfer_t* transfer) {
+    curl_multi_remove_handle(multi, transfer->curl);
+    curl_easy_cleanup(transfer->curl);
+    curl_slist_free_all(transfer->headers);
+    SDL_free(transfer);
+}
+
+// curl reports points in time since the start of the transfer, turn them into the duration of each phase
+static void collect_timings(CURL* curl, fetch_job_t* job) {
+    curl_off_t lookup = 0;
+    curl_off_t connect = 0;
+    curl_off_t app_connect = 0;
+    curl_off_t start_transfer = 0;
+    curl_off_t total = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &lookup);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &app_connect);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &start_transfer);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_off_t ready = SDL_max(connect, app_connect);
+    job->phase_us[fetch_phase_lookup] = (Uint64) lookup;
+    job->phase_us[fetch_phase_connect] = connect > lookup ? (Uint64) (connect - lookup) : 0;
+    job->phase_us[fetch_phase_tls] = app_connect > connect ? (Uint64) (app_connect - connect) : 0;
+    job->phase_us[fetch_phase_wait] = start_transfer > ready ? (Uint64) (start_transfer - ready) : 0;
+    job->phase_us[fetch_phase_total] = (Uint64) total;
+}
+
+static void curl_transport_poll(int timeout_ms) {
+    int running_handles = 0;
+    curl_multi_perform(multi, &running_handles);
+
+    CURLMsg* message;
+    int messages_left = 0;
+    while ((message = curl_multi_info_read(multi, &messages_left))) {
+        if (message->msg != CURLMSG_DONE) {
+            continue;
+        }
+        CURL* curl = message->easy_handle;
+        CURLcode res = message->data.result;
+        fetch_job_t* job = NULL;
+        curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**) &job);
+        long status = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        if (res != CURLE_OK) {
+            SDL_Log("ERROR in performing curl request for url %s: %s", job->url, curl_easy_strerror(res));
+        }
+        job->timed_out = res == CURLE_OPERATION_TIMEDOUT;
+        collect_timings(curl, job);
+        release((curl_transfer_t*) job->transport_data);
+        fetch_complete(job, res == CURLE_OK, status);
+    }
+
+    // Sleeps until there is socket activity or we get woken up
+    curl_multi_poll(multi, NULL, 0, timeout_ms, NULL);
+}
+
+static void curl_transport_wakeup(void) {
+    curl_multi_wakeup(multi);
+}
+
+static void curl_transport_abort(fetch_job_t* job) {
+    if (job->transport_data) {
+        release((curl_transfer_t*) job->transport_data);
+        job->transport_data = NULL;
+    }
+}
+
+static void curl_transport_shutdown(void) {
+    if (multi) {
+        curl_multi_cleanup(multi);
+        multi = NULL;
+    }
+    // The share handle can only go once no easy handle uses it anymore
+    destroy_share();
+}
+
+const fetch_transport_t transport_curl = {
+    .name = "curl",
+    .init = curl_transport_init,
+    .start = curl_transport_start,
+    .poll = curl_transport_poll,
+    .wakeup = curl_transport_wakeup,
+    .abort = curl_transport_abort,
+    .shutdown = curl_transport_shutdown
+};
@@ -0,0 +1,226 @@
+#include <SDL3/SDL.h>
+#include "transport.h"
+#include "config.h"
+
+// Comic number the fake transport reports as the latest one
+#define FAKE_LATEST_COMIC 3000
+#define FAKE_IMAGE_WIDTH 160
+#define FAKE_IMAGE_HEIGHT 120
+
+// A transfer of the fake transport that completes once its due time has passed
+typedef struct {
+    fetch_job_t* job;
+    Uint64 due;
+} fake_transfer_t;
+
+// Lets poll sleep until the timeout or until wakeup gets called
+static SDL_Mutex* wake_mutex = NULL;
+static SDL_Condition* wake_condition = NULL;
+static bool woken = false;
+
+// Only touched by the network thread
+static fake_transfer_t* fake_transfers = NULL;
+static int num_fake_transfers = 0;
+static int fake_transfers_capacity = 0;
+
+static bool local_init(void) {
+    wake_mutex = SDL_CreateMutex();
+    wake_condition = SDL_CreateCondition();
+    if (wake_mutex == NULL || wake_condition == NULL) {
+        SDL_Log("Could not create transport wakeup: '%s'\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+static void local_wait(int timeout_ms) {
+    SDL_LockMutex(wake_mutex);
+    if (!woken && timeout_ms > 0) {
+        SDL_WaitConditionTimeout(wake_condition, wake_mutex, timeout_ms);
+    }
+    woken = false;
+    SDL_UnlockMutex(wake_mutex);
+}
+
+static void local_wakeup(void) {
+    SDL_LockMutex(wake_mutex);
+    woken = true;
+    SDL_SignalCondition(wake_condition);
+    SDL_UnlockMutex(wake_mutex);
+}
+
+static void local_shutdown(void) {
+    SDL_DestroyCondition(wake_condition);
+    SDL_DestroyMutex(wake_mutex);
+    wake_condition = NULL;
+    wake_mutex = NULL;
+    SDL_free(fake_transfers);
+    fake_transfers = NULL;
+    num_fake_transfers = 0;
+    fake_transfers_capacity = 0;
+}
+
+// The path of the url, e.g. /6/info.0.json for https://xkcd.com/6/info.0.json
+static const char* url_path(const char* url) {
+    const char* scheme_end = SDL_strstr(url, "://");
+    if (scheme_end == NULL) {
+        return url;
+    }
+    const char* path = SDL_strchr(scheme_end + 3, '/');
+    return path ? path : "/";
+}
+
+static void file_start(fetch_job_t* job) {
+    char* path = NULL;
+    SDL_asprintf(&path, "%s%s", config.canned_dir, url_path(job->url));
+    size_t size = 0;
+    void* data = SDL_LoadFile(path, &size);
+    if (data == NULL) {
+        SDL_Log("ERROR in loading canned response %s for url %s", path, job->url);
+        fetch_complete(job, false, 404);
+    }
+    else {
+        bool ok = fetch_append_body(job, data, size);
+        fetch_complete(job, ok, ok ? 200 : 0);
+    }
+    SDL_free(data);
+    SDL_free(path);
+}
+
+static void file_poll(int timeout_ms) {
+    // Canned responses complete as soon as they start, all that is left is to wait for more work
+    local_wait(timeout_ms);
+}
+
+static void file_abort(fetch_job_t* job) {
+    (void) job;
+}
+
+static void put_le(Uint8* destination, Uint32 value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        destination[i] = (Uint8) (value >> (8 * i));
+    }
+}
+
+// An uncompressed 24 bit BMP in a colour derived from the comic number, cheap to make but still a real decode
+static void fake_image(fetch_job_t* job, int xkcd_number) {
+    const int row_size = (FAKE_IMAGE_WIDTH * 3 + 3) & ~3;
+    const int header_size = 54;
+    const int size = header_size + row_size * FAKE_IMAGE_HEIGHT;
+    Uint8* bmp = (Uint8*) SDL_calloc(1, size);
+    bmp[0] = 'B';
+    bmp[1] = 'M';
+    put_le(bmp + 2, size, 4);
+    put_le(bmp + 10, header_size, 4);
+    put_le(bmp + 14, 40, 4);
+    put_le(bmp + 18, FAKE_IMAGE_WIDTH, 4);
+    put_le(bmp + 22, FAKE_IMAGE_HEIGHT, 4);
+    put_le(bmp + 26, 1, 2);
+    put_le(bmp + 28, 24, 2);
+    Uint8 blue = (Uint8) (xkcd_number * 37);
+    Uint8 green = (Uint8) (xkcd_number * 91);
+    Uint8 red = (Uint8) (xkcd_number * 53);
+    for (int y = 0; y < FAKE_IMAGE_HEIGHT; y++) {
+        Uint8* row = bmp + header_size + y * row_size;
+        for (int x = 0; x < FAKE_IMAGE_WIDTH; x++) {
+            row[x * 3 + 0] = blue;
+            row[x * 3 + 1] = green;
+            row[x * 3 + 2] = red;
+        }
+    }
+    bool ok = fetch_append_body(job, bmp, (size_t) size);
+    SDL_free(bmp);
+    fetch_complete(job, ok, ok ? 200 : 0);
+}
+
+static void fake_respond(fetch_job_t* job) {
+    if (SDL_randf() < config.fake_failure_rate) {
+        fetch_complete(job, false, 503);
+        return;
+    }
+    const char* path = url_path(job->url);
+    int xkcd_number = 0;
+    if (SDL_sscanf(path, "/fake/%d.png", &xkcd_number) == 1) {
+        fake_image(job, xkcd_number);
+        return;
+    }
+    if (SDL_strcmp(path, "/info.0.json") == 0) {
+        xkcd_number = FAKE_LATEST_COMIC;
+    }
+    else if (SDL_sscanf(path, "/%d/info.0.json", &xkcd_number) != 1 || xkcd_number <= 0 || xkcd_number > FAKE_LATEST_COMIC) {
+        fetch_complete(job, false, 404);
+        return;
+    }
+    char* body = NULL;
+    int size = SDL_asprintf(&body,
+        "{\"month\": \"1\", \"num\": %d, \"link\": \"\", \"year\": \"2006\", \"news\": \"\", "
+        "\"safe_title\": \"Fake comic %d\", \"transcript\": \"\", \"alt\": \"Generated by the fake transport\", "
+        "\"img\": \"%s/fake/%d.png\", \"title\": \"Fake comic %d\", \"day\": \"1\"}",
+        xkcd_number, xkcd_number, config.base_url, xkcd_number, xkcd_number);
+    bool ok = size > 0 && fetch_append_body(job, body, (size_t) size);
+    SDL_free(body);
+    fetch_complete(job, ok, ok ? 200 : 0);
+}
+
+static void fake_start(fetch_job_t* job) {
+    if (num_fake_transfers == fake_transfers_capacity) {
+        fake_transfers_capacity = fake_transfers_capacity ? fake_transfers_capacity * 2 : 64;
+        fake_transfers = (fake_transfer_t*) SDL_realloc(fake_transfers, sizeof(fake_transfer_t) * fake_transfers_capacity);
+    }
+    // Spread the latency between half and one and a half times the configured value
+    float latency_ms = config.fake_latency_ms * (0.5f + SDL_randf());
+    fake_transfers[num_fake_transfers++] = (fake_transfer_t) {
+        .job = job,
+        .due = SDL_GetTicksNS() + (Uint64) (latency_ms * SDL_NS_PER_MS)
+    };
+}
+
+static void fake_poll(int timeout_ms) {
+    Uint64 now = SDL_GetTicksNS();
+    Uint64 next_due = now + SDL_MS_TO_NS(timeout_ms);
+    bool responded = false;
+    for (int i = 0; i < num_fake_transfers;) {
+        fake_transfer_t transfer = fake_transfers[i];
+        if (transfer.due <= now) {
+            fake_transfers[i] = fake_transfers[--num_fake_transfers];
+            fake_respond(transfer.job);
+            responded = true;
+            continue;
+        }
+        next_due = SDL_min(next_due, transfer.due);
+        i++;
+    }
+    // Finished transfers make room for new ones, so those return right away like curl does. Otherwise
+    // the wait is rounded up, a transfer due in less than a millisecond would be a wait of 0 and the
+    // network thread would spin until it is due
+    local_wait(responded ? 0 : (int) SDL_NS_TO_MS(next_due - now + SDL_NS_PER_MS - 1));
+}
+
+static void fake_abort(fetch_job_t* job) {
+    for (int i = 0; i < num_fake_transfers; i++) {
+        if (fake_transfers[i].job == job) {
+            fake_transfers[i] = fake_transfers[--num_fake_transfers];
+            return;
+        }
+    }
+}
+
+const fetch_transport_t transport_file = {
+    .name = "file",
+    .init = local_init,
+    .start = file_start,
+    .poll = file_poll,
+    .wakeup = local_wakeup,
+    .abort = file_abort,
+    .shutdown = local_shutdown
+};
+
+const fetch_transport_t transport_fake = {
+    .name = "fake",
+    .init = local_init,
+    .start = fake_start,
+    .poll = fake_poll,
+    .wakeup = local_wakeup,
+    .abort = fake_abort,
+    .shutdown = local_shutdown
+};
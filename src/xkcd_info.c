@@ -0,0 +1,188 @@
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include "xkcd_info.h"
+#include "arena.h"
+#include "fetch.h"
+
+typedef enum {
+    xkcd_field_int,
+    xkcd_field_string
+} xkcd_field_kind;
+
+typedef struct {
+    const char* name;
+    size_t name_size;
+    size_t offset; // Of the member in xkcd_info_t
+    xkcd_field_kind kind;
+} xkcd_field_t;
+
+#define XKCD_FIELD_ENTRY(name, kind) { #name, sizeof(#name) - 1, offsetof(xkcd_info_t, name), xkcd_field_##kind },
+static const xkcd_field_t fields[] = { XKCD_INFO_FIELDS(XKCD_FIELD_ENTRY) };
+#undef XKCD_FIELD_ENTRY
+
+#define XKCD_FIELD_INDEX(name, kind) field_##name,
+enum { XKCD_INFO_FIELDS(XKCD_FIELD_INDEX) };
+#undef XKCD_FIELD_INDEX
+
+// A key told apart by its length and first byte
+#define FIELD_KEY(size, first) ((size) << 8 | (first))
+
+#define NUM_FIELDS SDL_arraysize(fields)
+
+typedef struct {
+    xkcd_info_t info;
+    bool complete; // The root object has ended
+    int depth; // Nesting level of the event, the fields are the elements of the root object at level 1
+    bool is_object;
+    bool failed;
+    const xkcd_field_t* field; // Field the next value belongs to, NULL if it is skipped
+    // Unescaped strings, null terminated. Reset with the decoder, so once the arena has grown to the size
+    // of a comic decoding one no longer touches the heap
+    arena_t strings;
+} decoder_t;
+
+// Used by xkcd_info_decode on the main thread
+static decoder_t* text_decoder = NULL;
+static struct json_stream_s* text_stream = NULL;
+
+// Every name is told apart by its length and first byte, the compare only confirms the match.
+// name is null terminated, so name[0] can be read even for an empty key
+static const xkcd_field_t* find_field(const char* name, size_t name_size) {
+    if (name_size > 0xff) {
+        return NULL;
+    }
+    const xkcd_field_t* field = NULL;
+    switch (FIELD_KEY(name_size, (unsigned char) name[0])) {
+        case FIELD_KEY(3, 'n'): field = &fields[field_num]; break;
+        case FIELD_KEY(4, 'y'): field = &fields[field_year]; break;
+        case FIELD_KEY(5, 'm'): field = &fields[field_month]; break;
+        case FIELD_KEY(3, 'd'): field = &fields[field_day]; break;
+        case FIELD_KEY(5, 't'): field = &fields[field_title]; break;
+        case FIELD_KEY(10, 's'): field = &fields[field_safe_title]; break;
+        case FIELD_KEY(3, 'a'): field = &fields[field_alt]; break;
+        case FIELD_KEY(3, 'i'): field = &fields[field_img]; break;
+        case FIELD_KEY(10, 't'): field = &fields[field_transcript]; break;
+        case FIELD_KEY(4, 'l'): field = &fields[field_link]; break;
+        case FIELD_KEY(4, 'n'): field = &fields[field_news]; break;
+        default: return NULL;
+    }
+    return SDL_memcmp(field->name, name, name_size) == 0 ? field : NULL;
+}
+
+static void store_value(decoder_t* decoder, const xkcd_field_t* field, enum json_stream_event_e event, const char* data, size_t size) {
+    char* member = (char*) &decoder->info + field->offset;
+    if (field->kind == xkcd_field_int) {
+        if (event == json_stream_event_number || event == json_stream_event_string) {
+            *(int*) member = SDL_atoi(data);
+        }
+        return;
+    }
+    if (event != json_stream_event_string) {
+        return;
+    }
+    char* string = (char*) arena_alloc(&decoder->strings, size + 1);
+    if (string == NULL) {
+        decoder->failed = true;
+        return;
+    }
+    SDL_memcpy(string, data, size + 1);
+    *(xkcd_string_t*) member = (xkcd_string_t) { string, size };
+}
+
+static void on_event(void* user_data, enum json_stream_event_e event, const char* data, size_t size) {
+    decoder_t* decoder = (decoder_t*) user_data;
+    if (decoder->depth == 0) {
+        decoder->is_object = event == json_stream_event_object_begin;
+    }
+    else if (decoder->depth == 1 && event == json_stream_event_key) {
+        decoder->field = find_field(data, size);
+        return;
+    }
+    else if (decoder->depth == 1 && decoder->field) {
+        store_value(decoder, decoder->field, event, data, size);
+        decoder->field = NULL;
+    }
+    if (event == json_stream_event_object_begin || event == json_stream_event_array_begin) {
+        decoder->depth++;
+    }
+    else if (event == json_stream_event_object_end || event == json_stream_event_array_end) {
+        decoder->depth--;
+        decoder->complete = decoder->depth == 0 && decoder->is_object;
+    }
+}
+
+static void reset_decoder(void* state) {
+    decoder_t* decoder = (decoder_t*) state;
+    SDL_zero(decoder->info);
+    decoder->complete = false;
+    decoder->depth = 0;
+    decoder->is_object = false;
+    decoder->failed = false;
+    decoder->field = NULL;
+    arena_reset(&decoder->strings);
+}
+
+static void* create_decoder(void) {
+    // A field added to XKCD_INFO_FIELDS needs a case in find_field
+    for (size_t i = 0; i < NUM_FIELDS; i++) {
+        assert(find_field(fields[i].name, fields[i].name_size) == &fields[i]);
+    }
+    decoder_t* decoder = (decoder_t*) SDL_calloc(1, sizeof(decoder_t));
+    if (decoder) {
+        reset_decoder(decoder);
+    }
+    return decoder;
+}
+
+static void destroy_decoder(void* state) {
+    decoder_t* decoder = (decoder_t*) state;
+    if (decoder) {
+        arena_destroy(&decoder->strings);
+        SDL_free(decoder);
+    }
+}
+
+const fetch_decoder_t xkcd_info_decoder = { create_decoder, reset_decoder, destroy_decoder, on_event };
+
+const xkcd_info_t* xkcd_info_decoded(const void* decoded) {
+    const decoder_t* decoder = (const decoder_t*) decoded;
+    if (decoder == NULL || !decoder->complete || decoder->failed) {
+        return NULL;
+    }
+    return &decoder->info;
+}
+
+bool xkcd_info_decode(const char* json, size_t size, xkcd_info_t* info) {
+    SDL_zerop(info);
+    if (text_decoder == NULL) {
+        text_decoder = (decoder_t*) create_decoder();
+        if (text_decoder == NULL) {
+            return false;
+        }
+    }
+    if (text_stream == NULL) {
+        text_stream = json_stream_create(on_event, text_decoder);
+        if (text_stream == NULL) {
+            return false;
+        }
+    }
+    // The strings of the previous call are still handed out until now
+    reset_decoder(text_decoder);
+    json_stream_feed(text_stream, json, size);
+    struct json_parse_result_s result;
+    json_stream_finish(text_stream, &result);
+    json_stream_reset(text_stream);
+    const xkcd_info_t* decoded = xkcd_info_decoded(text_decoder);
+    if (result.error != json_parse_error_none || decoded == NULL) {
+        return false;
+    }
+    *info = *decoded;
+    return true;
+}
+
+void xkcd_info_shutdown(void) {
+    json_stream_destroy(text_stream);
+    text_stream = NULL;
+    destroy_decoder(text_decoder);
+    text_decoder = NULL;
+}
@@ -0,0 +1,61 @@
+#ifndef XKCD_INFO_H
+#define XKCD_INFO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A string that is not necessarily null terminated, points into memory owned by someone else
+typedef struct {
+    const char* data;
+    size_t size;
+} xkcd_string_t;
+
+// The metadata of a single comic as served by https://xkcd.com/<num>/info.0.json
+typedef struct {
+    int num;
+    int year;
+    int month;
+    int day;
+    xkcd_string_t title;
+    xkcd_string_t safe_title;
+    xkcd_string_t alt;
+    xkcd_string_t img;
+    xkcd_string_t transcript;
+    xkcd_string_t link;
+    xkcd_string_t news;
+} xkcd_info_t;
+
+// The fields of info.0.json that make up xkcd_info_t, as X(name, kind) with kind either int or string.
+// Ints are accepted as numbers or strings, xkcd sends the date parts as strings
+#define XKCD_INFO_FIELDS(X) \
+    X(num, int) \
+    X(year, int) \
+    X(month, int) \
+    X(day, int) \
+    X(title, string) \
+    X(safe_title, string) \
+    X(alt, string) \
+    X(img, string) \
+    X(transcript, string) \
+    X(link, string) \
+    X(news, string)
+
+struct fetch_decoder_s;
+
+// Decodes info.0.json responses of fetch_submit_json on the network thread while they download, without
+// building a DOM
+extern const struct fetch_decoder_s xkcd_info_decoder;
+
+// The comic xkcd_info_decoder decoded into response->decoded, NULL if the body was not a JSON object.
+// Missing fields are left zero. The strings point into the decoder and stay valid during the done callback
+const xkcd_info_t* xkcd_info_decoded(const void* decoded);
+
+// Decodes an info.0.json response that was fetched as text straight into info. The strings point into a
+// buffer that is reused by the next call, call on the main thread only.
+// Returns false if json is not a valid JSON object
+bool xkcd_info_decode(const char* json, size_t size, xkcd_info_t* info);
+
+// Frees the decoder of xkcd_info_decode
+void xkcd_info_shutdown(void);
+
+#endif
@@ -0,0 +1,123 @@
+// Checks that the parse modes of json.h agree with json_parse, see `make test`
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/json.h"
+
+typedef struct {
+    const char* name;
+    const char* text;
+} test_case_t;
+
+// Every case goes through json_parse, json_parse_in_situ and the push parser. They have to accept and
+// reject the same documents, and the documents they accept have to come out the same
+static const test_case_t cases[] = {
+    { "surrogate pair", "[\"\\ud83d\\ude00\"]" },
+    { "high surrogate followed by a letter", "[\"\\ud83dx\\ude00\"]" },
+    { "high surrogate followed by a dash", "[\"\\ud83d-\\ude00\"]" },
+    { "high surrogate at the end", "[\"\\ud83d\"]" },
+    { "high surrogate followed by an escape", "[\"\\ud83d\\n\"]" },
+    { "lone low surrogate", "[\"\\ude00\"]" },
+    { "raw control character", "[\"a\x01" "b\"]" },
+    { "raw unit separator", "[\"\x1f\"]" },
+    { "raw tab", "[\"a\tb\"]" },
+    { "raw line feed", "[\"a\nb\"]" },
+    { "raw carriage return", "[\"a\rb\"]" },
+};
+
+// Random documents are glued together from these, they are picked to hit the corners of strings
+static const char* fragments[] = {
+    "[", "]", "{", "}", ",", ":", "\"", "\\", "\\u", "d83d", "de00", "\\ud83d", "\\ude00", "0041", "00e9", "\\n", "\\\"", "x", "-", " ", "\x01", "\x1f", "\t", "\n",
+};
+
+#define NUM_RANDOM 200000
+#define MAX_RANDOM_FRAGMENTS 12
+
+static unsigned int random_state = 1;
+
+static unsigned int next_random(void) {
+    random_state = random_state * 1103515245u + 12345u;
+    return random_state >> 16;
+}
+
+static void make_random(char* text) {
+    int num_fragments = 1 + (int) (next_random() % MAX_RANDOM_FRAGMENTS);
+    // They start inside a string, the structure around it is not what is being tested
+    strcpy(text, "[\"");
+    for (int i = 0; i < num_fragments; i++) {
+        strcat(text, fragments[next_random() % (sizeof(fragments) / sizeof(fragments[0]))]);
+    }
+}
+
+// Minified text of the DOM, NULL if the document was rejected
+static char* parse(const char* text) {
+    struct json_value_s* dom = json_parse(text, strlen(text));
+    char* minified = dom ? json_write_minified(dom, NULL) : NULL;
+    free(dom);
+    return minified;
+}
+
+static char* parse_in_situ(const char* text) {
+    char* copy = strdup(text);
+    struct json_value_s* dom = json_parse_in_situ(copy, strlen(copy), NULL, NULL, NULL);
+    char* minified = dom ? json_write_minified(dom, NULL) : NULL;
+    free(dom);
+    free(copy);
+    return minified;
+}
+
+// Fed one byte at a time, so every token spans chunks
+static char* parse_stream(const char* text) {
+    struct json_stream_s* stream = json_stream_create(NULL, NULL);
+    for (size_t i = 0; text[i]; i++) {
+        json_stream_feed(stream, text + i, 1);
+    }
+    struct json_value_s* dom = json_stream_finish(stream, NULL);
+    json_stream_destroy(stream);
+    char* minified = dom ? json_write_minified(dom, NULL) : NULL;
+    free(dom);
+    return minified;
+}
+
+static bool same(const char* expected, const char* actual) {
+    if (expected == NULL || actual == NULL) {
+        return expected == actual;
+    }
+    return strcmp(expected, actual) == 0;
+}
+
+static bool check(const test_case_t* test_case, const char* mode, const char* expected, char* actual) {
+    bool ok = same(expected, actual);
+    if (!ok) {
+        printf("FAILED %s (%s): json_parse %s, %s %s\n", test_case->name, mode,
+            expected ? expected : "rejects", mode, actual ? actual : "rejects");
+    }
+    free(actual);
+    return ok;
+}
+
+int main(void) {
+    int failed = 0;
+    int num_cases = (int) (sizeof(cases) / sizeof(cases[0]));
+    for (int i = 0; i < num_cases; i++) {
+        char* expected = parse(cases[i].text);
+        failed += !check(&cases[i], "json_parse_in_situ", expected, parse_in_situ(cases[i].text));
+        failed += !check(&cases[i], "json_stream", expected, parse_stream(cases[i].text));
+        free(expected);
+    }
+    static char text[MAX_RANDOM_FRAGMENTS * 8 + 8];
+    int random_failed = 0;
+    for (int i = 0; i < NUM_RANDOM && random_failed < 10; i++) {
+        make_random(text);
+        test_case_t random_case = { text, text };
+        char* expected = parse(text);
+        random_failed += !check(&random_case, "json_parse_in_situ", expected, parse_in_situ(text));
+        random_failed += !check(&random_case, "json_stream", expected, parse_stream(text));
+        free(expected);
+    }
+    failed += random_failed;
+    printf("%d cases and %d random documents, %d failed\n", num_cases, NUM_RANDOM, failed);
+    return failed ? 1 : 0;
+}